@@ -1,30 +1,132 @@
 #include "cumagic.h"
+#include "cumagicagg.h"
+#include "cumagicscheduler.h"
+#include "cumagiccapture.h"
+#include "cumagicshm.h"
+#include "cumagicraw.h"
+#include "cumbiasynth.h"
+#include "cumagichistogram.h"
 #include <cucontext.h>
 #include <cucontrolsreader_abs.h>
 #include <cudata.h>
 #include <QTimer>
 #include <QMap>
-#include <QtDebug>
 #include <cucontrolsreader_abs.h>
 #include <qwidget.h>
 #include <QMetaProperty>
+#include <QMetaMethod>
 #include <qustringlist.h>
 #include <qustring.h>
 #include <QRegularExpression>
+#include <QLabel>
+#include <QPixmap>
+#include <QEvent>
+#include <QThread>
+#include <QStyle>
+#include <QSignalBlocker>
+#include <QApplication>
+#include <time.h>
+
+/*
+ * (CuVariant::DataType x target kind) --> setter, generated once from the setter templates
+ * (see CuMagicDispatch::fill).
+ * One splitter per CuVariant::DataType is used when values are mapped onto several objects
+ */
+struct CuMagicDispatch {
+    CuMagicDispatch();
+    void fill_conv(CuVariant::DataType dt);
+    template <typename T, typename DynT> void fill(CuVariant::DataType dt);
+    template <typename S> void fill_mx(CuVariant::DataType sdt);
+    template <typename D> void mx_type(CuVariant::DataType dt);
+
+    CuMagicSplitter split[CuVariant::EndDataTypes];
+    CuMagicDecimator decim[CuVariant::EndDataTypes];
+    CuMagicSetter set[CuVariant::EndDataTypes][CuMagic::TkEndKinds];
+    // matrix of data type --> CuMatrix property of another element type
+    CuMagicSetter mx[CuVariant::EndDataTypes][CuVariant::EndDataTypes];
+    QHash<int, int> mx_types; // CuMatrix<T> meta type id --> CuVariant::DataType of T
+};
+
+// "1,2,4-8" --> 1, 2, 4, 5, 6, 7, 8 appended to out. false on syntax errors
+static bool m_ranges(const QString& s, QList<int>& out) {
+    QRegularExpression re2("(\\d+)\\s*\\-\\s*(\\d+)");
+    bool ok = true;
+    foreach(const QString &t, s.split(',') ) {
+        if(!t.contains('-') && t.toInt(&ok) >= 0 && ok)
+            out << t.trimmed().toInt(&ok);
+        else if(t.contains(re2) && ok) {
+            QRegularExpressionMatch m2 = re2.match(t);
+            const QStringList& ct = m2.capturedTexts();
+            int to = -1, from = ct[1].toInt(&ok);
+            if(ok) to = ct[2].toInt(&ok);
+            for( int q = from; ok && q <= to; q++)
+                out << q;
+        }
+        if(!ok ) break;
+    }
+    return ok;
+}
+
+// 1, 2, 4, 5, 6, 7, 8 --> "1,2,4-8"
+static QString m_ranges_to_string(const QList<int>& l) {
+    QString s;
+    int i = 0, j = 0;
+    while(i < l.size()) {
+        j = i;
+        while(j + 1 < l.size() && l[j+1] - l[j] == 1)
+            j++;
+        if(j > i && j <= l.size()) {
+            s += QString("%1-%2").arg(l[i]).arg(l[j]);
+        }
+        else
+            s += QString("%1").arg(l[i]);
+        if(j < l.size() - 1)
+            s += ",";
+        i = j + 1;
+    }
+    return s;
+}
 
 class CuMagicPluginPrivate {
 public:
     CumbiaPool *cu_pool;
     CuControlsFactoryPool fpoo;
+    CuMagicScheduler *sched;
+    CuMagicCapture *capture;
+    CuMagicLatency latency;
+    CuMagicShm shm;
+    CumbiaSynth *synth; // see registerSynthEngine
+    bool lazy;
+    int lazy_hide_ms;
 };
 
 CuMagicPlugin::CuMagicPlugin(QObject *parent) : QObject(parent)
 {
     d = new CuMagicPluginPrivate;
+    d->sched = new CuMagicScheduler(this);
+    d->capture = new CuMagicCapture(this);
+    connect(d->capture, SIGNAL(replayFinished()), this, SIGNAL(replayFinished()));
+    d->lazy = false;
+    d->lazy_hide_ms = 0;
+    d->synth = nullptr;
     qRegisterMetaType<CuMatrix<double>>("CuMatrix<double>");
+    // vectors set on dynamic properties, see CuMagic::setDynamicVariantList
+    qRegisterMetaType<QVector<double>>("QVector<double>");
+    qRegisterMetaType<QVector<float>>("QVector<float>");
+    qRegisterMetaType<QVector<int>>("QVector<int>");
+    qRegisterMetaType<QVector<long long>>("QVector<long long>");
+    qRegisterMetaType<QVector<unsigned int>>("QVector<unsigned int>");
+    qRegisterMetaType<QVector<unsigned long long>>("QVector<unsigned long long>");
+    qRegisterMetaType<QVector<short>>("QVector<short>");
+    qRegisterMetaType<QVector<unsigned short>>("QVector<unsigned short>");
+    qRegisterMetaType<QVector<bool>>("QVector<bool>");
 }
 
 CuMagicPlugin::~CuMagicPlugin() {
+    if(d->synth) {
+        d->cu_pool->unregisterCumbiaImpl("synth");
+        delete d->synth;
+    }
     delete d;
 }
 
@@ -37,7 +139,38 @@ CuMagicPlugin::~CuMagicPlugin() {
  * *source* and *property* are optional and can be specified later on the CuMagic object
  */
 CuMagicI *CuMagicPlugin::new_magic(QObject *target, const QString &source, const QString &property) const {
-    return new CuMagic(target, d->cu_pool, d->fpoo, source, property);
+    CuMagic *m = new CuMagic(target, d->cu_pool, d->fpoo, QString(), property);
+    m->setScheduler(d->sched);
+    m->setCapture(d->capture);
+    m->setLatency(&d->latency);
+    m->setShm(&d->shm);
+    if(d->lazy)
+        m->setLazyConnect(true, d->lazy_hide_ms);
+    if(!source.isEmpty())
+        m->setSource(source);
+    return m;
+}
+
+/*!
+ * \brief CuMagicPlugin::new_magic_headless create a new CuMagic that delivers data to target in the target's thread
+ *
+ * See CuMagicPluginInterface::new_magic_headless
+ */
+CuMagicI *CuMagicPlugin::new_magic_headless(QObject *target, const QString &source, const QString &property) const {
+    CuMagic *m = new CuMagic(target, d->cu_pool, d->fpoo, source, property, true);
+    m->setCapture(d->capture);
+    m->setLatency(&d->latency);
+    m->setShm(&d->shm);
+    return m;
+}
+
+/*!
+ * \brief CuMagicPlugin::new_magic_agg create a new CuMagicAgg instance
+ *
+ * See CuMagicAgg constructor documentation
+ */
+CuMagicAggI *CuMagicPlugin::new_magic_agg(QObject *target, const QStringList &sources, const QString &property) const {
+    return new CuMagicAgg(target, d->cu_pool, d->fpoo, sources, property);
 }
 
 void CuMagicPlugin::init(CumbiaPool *cumbia_pool, const CuControlsFactoryPool &fpool) {
@@ -45,6 +178,97 @@ void CuMagicPlugin::init(CumbiaPool *cumbia_pool, const CuControlsFactoryPool &f
     d->fpoo = fpool;
 }
 
+/*!
+ * \brief CuMagicPlugin::setUpdateBudget time given to the magics in each event loop cycle to apply their updates
+ *
+ * See CuMagicScheduler
+ */
+void CuMagicPlugin::setUpdateBudget(int us) {
+    d->sched->setBudget(us);
+}
+
+int CuMagicPlugin::updateBudget() const {
+    return d->sched->budget();
+}
+
+QStringList CuMagicPlugin::latencySources() const {
+    return d->latency.sources();
+}
+
+/*!
+ * \brief CuMagicPlugin::latencyPercentile latency percentile of all the magics reading source, in microseconds
+ */
+double CuMagicPlugin::latencyPercentile(const QString &source, int stage, double p) const {
+    return d->latency.histogram(source, stage).percentile(p);
+}
+
+QVector<quint64> CuMagicPlugin::latencyHistogram(const QString &source, int stage) const {
+    return d->latency.histogram(source, stage).buckets();
+}
+
+void CuMagicPlugin::resetLatency() {
+    d->latency.reset();
+}
+
+/*!
+ * \brief CuMagicPlugin::registerSynthEngine serve *synth://* sources to the magics from the CumbiaSynth engine
+ *
+ * See CumbiaSynth
+ */
+void CuMagicPlugin::registerSynthEngine() {
+    if(!d->synth)
+        d->synth = CumbiaSynth::registerInto(d->cu_pool, d->fpoo);
+}
+
+/*!
+ * \brief CuMagicPlugin::startRecording record the data received by the magics into the capture file path
+ *
+ * See CuMagicCapture
+ */
+bool CuMagicPlugin::startRecording(const QString &path, qint64 maxBytes) {
+    return d->capture->startRecording(path, maxBytes);
+}
+
+void CuMagicPlugin::stopRecording() {
+    d->capture->stopRecording();
+}
+
+/*!
+ * \brief CuMagicPlugin::startReplay deliver the data in the capture file path to the magics
+ *
+ * See CuMagicCapture
+ */
+bool CuMagicPlugin::startReplay(const QString &path, double speed) {
+    return d->capture->startReplay(path, speed);
+}
+
+void CuMagicPlugin::stopReplay() {
+    d->capture->stopReplay();
+}
+
+/*!
+ * \brief CuMagicPlugin::startShmExport publish the values applied by the magics into the shared memory segment name
+ *
+ * See CuMagicShm
+ */
+bool CuMagicPlugin::startShmExport(const QString &name, int nslots, int slotSize) {
+    return d->shm.start(name, nslots, slotSize);
+}
+
+void CuMagicPlugin::stopShmExport() {
+    d->shm.stop();
+}
+
+/*!
+ * \brief CuMagicPlugin::setLazyConnect default for the magics created afterwards with new_magic
+ *
+ * See CuMagic::setLazyConnect
+ */
+void CuMagicPlugin::setLazyConnect(bool lazy, int disconnectAfterMs) {
+    d->lazy = lazy;
+    d->lazy_hide_ms = disconnectAfterMs;
+}
+
 /*!
  * \brief CuMagic::CuMagic magic object that can be attached to any Qt object to display read values
  * \param target the target object, which becomes the parent of this object (means automatic destruction)
@@ -52,6 +276,9 @@ void CuMagicPlugin::init(CumbiaPool *cumbia_pool, const CuControlsFactoryPool &f
  * \param fpoo a const reference to CuControlsFactoryPool
  * \param src the source for the readings. Can additionally be provided later with setSource
  * \param property if specified, write the provided *property* instead of automatically guessing the property
+ * \param headless if true, the target does not become the parent of this object: this object is moved to the
+ *        thread of the target, data is applied in that thread and widget side effects (disabling, tooltips) are
+ *        skipped. This object is deleted when the target is destroyed
  *
  * \par Implementation
  * CuMagic reads from source and tries to display the result according to the available properties of the
@@ -72,51 +299,324 @@ void CuMagicPlugin::init(CumbiaPool *cumbia_pool, const CuControlsFactoryPool &f
  * \par Properties
  * \li *disable_on_error*: if false, a read error does not disable the target. Default: if widget, the target is disabled
  */
-CuMagic::CuMagic(QObject *target, CumbiaPool *cu_pool, const CuControlsFactoryPool &fpoo, const QString& src, const QString& property) :
-    QObject(target)
+CuMagic::CuMagic(QObject *target, CumbiaPool *cu_pool, const CuControlsFactoryPool &fpoo, const QString& src, const QString& property, bool headless) :
+    QObject(headless ? nullptr : target)
 {
     d = new CuMagicPrivate;
     d->context = new CuContext(cu_pool, fpoo);
+    d->target = target;
+    d->headless = headless;
+    d->ctx_thread = QThread::currentThread();
+    d->relay = nullptr;
+    if(headless) { // live in the thread of the target and go with it. The relay stays with the context
+        d->relay = new CuMagicRelay(this);
+        moveToThread(target->thread());
+        connect(target, SIGNAL(destroyed()), this, SLOT(deleteLater()));
+    }
     d->on_error_value = CuVariant(-1);
     d->t_prop = property;
     d->format = "%.2f";
     d->onetime = false;
+    d->xform = false;
+    d->xf_scale = 1.0;
+    d->xf_offset = 0.0;
+    d->xf_min = -std::numeric_limits<double>::infinity();
+    d->xf_max = std::numeric_limits<double>::infinity();
+    d->img_min = d->img_max = 0.0;
+    d->roi.on = false;
+    d->bits_last = 0;
+    d->bits_valid = false;
+    d->bin_rows = d->bin_cols = 1;
+    d->bin_mode = CuMagicI::BinMean;
+    d->decim = 0;
+    d->range_thr = 0.25;
+    d->dyn_vlist = false;
+    d->backoff_max = 0;
+    d->prio = -1;
+    d->period = 0;
+    d->lazy = false;
+    d->hide_ms = 0;
+    d->hide_timer = nullptr;
+    d->backoff_on = false;
+    d->adapt_max = 0;
+    d->adapt_n = 5;
+    d->adapt_same = 0;
+    d->latency = nullptr;
+    d->lat_e = nullptr;
+    d->shm = nullptr;
+    d->roi.r0 = d->roi.c0 = 0;
+    d->roi.r1 = d->roi.c1 = -1;
+    d->lut.resize(256);
+    for(int i = 0; i < 256; i++)
+        d->lut[i] = qRgb(i, i, i);
     if(!src.isEmpty()) CuMagic::setSource(src);
 }
 
 CuMagic::~CuMagic()
 {
-    printf("\e[1;31mCuMagic.~CuMagic %p\e[0m\n", this);
-    if(d->context)
+    if(d->sched)
+        d->sched->remove(this);
+    if(d->capture)
+        d->capture->remove(this);
+    if(d->relay) // no more data after detach. The context is deleted in its thread
+        d->relay->detach(d->context);
+    else if(d->context)
         delete d->context;
     delete d;
 }
 
+CuMagicRelay::CuMagicRelay(CuMagic *m) : m_magic(m), m_ctx(nullptr) {
+}
+
+CuMagicRelay::~CuMagicRelay() {
+    delete m_ctx;
+}
+
+void CuMagicRelay::onUpdate(const CuData &da) {
+    QMutexLocker lo(&m_mu);
+    if(m_magic)
+        m_magic->onUpdate(da);
+}
+
+// waits for onUpdate in progress, then takes ctx and deletes itself in the thread of the context
+void CuMagicRelay::detach(CuContext *ctx) {
+    QMutexLocker lo(&m_mu);
+    m_magic = nullptr;
+    m_ctx = ctx;
+    deleteLater();
+}
+
 void CuMagic::setErrorValue(const CuVariant &v) {
     d->on_error_value = v;
 }
 
+/*!
+ * \brief CuMagic::setTransform scale, offset and clamp numeric values before setting them on the target
+ *
+ * Each value *x* becomes *min(max(x * scale + offset, clampMin), clampMax)*. Values are rounded to the
+ * nearest integer if the target property is an integer.
+ *
+ * \see clearTransform
+ */
+void CuMagic::setTransform(double scale, double offset, double clampMin, double clampMax) {
+    d->xform = true;
+    d->xf_scale = scale;
+    d->xf_offset = offset;
+    d->xf_min = clampMin;
+    d->xf_max = clampMax;
+}
+
+void CuMagic::clearTransform() {
+    d->xform = false;
+}
+
+/*!
+ * \brief CuMagic::setImageRange set the values mapped to the first and last colormap entries
+ *        when matrix data is shown as an image
+ *
+ * If min is not less than max, the range is computed on each frame (default)
+ *
+ * \see setColormap
+ */
+void CuMagic::setImageRange(double min, double max) {
+    d->img_min = min;
+    d->img_max = max;
+}
+
+/*!
+ * \brief CuMagic::setColormap set the 256 colors used to show matrix data as an image
+ * \param lut 256 QRgb values. Default: gray scale
+ */
+void CuMagic::setColormap(const QVector<QRgb> &lut) {
+    if(lut.size() != 256)
+        perr("CuMagic.setColormap: the colormap must have 256 entries (%d given)", lut.size());
+    else
+        d->lut = lut;
+}
+
+/*!
+ * \brief CuMagic::setBinning reduce matrix data by blocks of rows x cols elements before delivery
+ * \param rows number of rows in a block, 0: reduce to about the height of the target widget
+ * \param cols number of columns in a block, 0: reduce to about the width of the target widget
+ * \param mode each block is replaced by its mean, its maximum or its top left element
+ *
+ * Binning is applied after the region of interest is selected, if any. 1 x 1 blocks disable binning (default)
+ */
+void CuMagic::setBinning(int rows, int cols, BinMode mode) {
+    d->bin_rows = std::max(rows, 0);
+    d->bin_cols = std::max(cols, 0);
+    d->bin_mode = mode;
+}
+
+/*!
+ * \brief CuMagic::setDecimation reduce long vectors set on QVector or QList properties to about points values
+ * \param points 0: no decimation (default), -1: twice the width of the target widget, otherwise the number of points
+ *
+ * Min/max decimation splits the data into points / 2 buckets and keeps the minimum and maximum of each one.
+ * The indexes of the values kept are set on the property mapped from *x* with mapProperty, if any.
+ * Decimation does not apply if indexes are specified in the source.
+ */
+void CuMagic::setDecimation(int points) {
+    d->decim = points;
+}
+
+/*!
+ * \brief CuMagic::setRangeUpdateThreshold call the target updateRange(int, QVector<T>) with the changed
+ *        runs of values only, unless more than fraction of the values changed
+ * \param fraction 0: always set the whole vector on the property. Default: 0.25
+ */
+void CuMagic::setRangeUpdateThreshold(double fraction) {
+    d->range_thr = fraction;
+    for(QHash<QPair<const QObject *, QString>, CuMagicBinding>::iterator it = d->bindings.begin(); it != d->bindings.end(); ++it)
+        it->last = QVariant();
+}
+
+/*!
+ * \brief CuMagic::setDynamicVariantList set vectors on dynamic properties as QVariantList instead of QVector<T>
+ */
+void CuMagic::setDynamicVariantList(bool vlist) {
+    d->dyn_vlist = vlist;
+}
+
+/*!
+ * \brief CuMagic::setErrorBackoff double the polling period on each error, up to maxPeriodMs, until the source recovers
+ * \param maxPeriodMs the longest period, in milliseconds. 0 disables the backoff (default)
+ */
+void CuMagic::setErrorBackoff(int maxPeriodMs) {
+    d->backoff_max = std::max(maxPeriodMs, 0);
+    if(d->backoff_max == 0 && d->period > m_base_period())
+        m_set_period(m_base_period());
+}
+
+/*!
+ * \brief CuMagic::setScheduler apply updates through the scheduler s instead of as soon as they arrive
+ */
+void CuMagic::setScheduler(CuMagicScheduler *s) {
+    d->sched = s;
+    d->prio = -1;
+    if(s && !d->headless) { // keep track of the events that change the priority
+        d->target->installEventFilter(this);
+        if(qobject_cast<QWidget *>(d->target))
+            connect(qApp, SIGNAL(focusChanged(QWidget*,QWidget*)), this, SLOT(m_priority_changed()), Qt::UniqueConnection);
+    }
+}
+
+/*!
+ * \brief CuMagic::setCapture record incoming data into c, when recording, and receive data replayed by c
+ */
+void CuMagic::setCapture(CuMagicCapture *c) {
+    if(d->capture)
+        d->capture->remove(this);
+    d->capture = c;
+    if(c)
+        c->add(this);
+}
+
+/*!
+ * \brief CuMagic::setLatency record the latencies of this magic also into l, by source
+ */
+void CuMagic::setLatency(CuMagicLatency *l) {
+    QMutexLocker lo(&d->mu);
+    d->latency = l;
+    d->lat_e = l && !d->rq_src.isEmpty() ? l->entry(d->rq_src) : nullptr;
+}
+
+/*!
+ * \brief CuMagic::setShm publish the data applied by this magic into shm, while exporting
+ */
+void CuMagic::setShm(CuMagicShm *shm) {
+    d->shm = shm;
+}
+
+/*!
+ * \brief CuMagic::latencyPercentile the latency below which the fraction p of the updates fall, in microseconds
+ *
+ * -1 if no update with a timestamp has been applied since the last reset. See CuMagicHistogram
+ */
+double CuMagic::latencyPercentile(LatencyStage stage, double p) const {
+    QMutexLocker lo(&d->mu);
+    return d->lat[stage].percentile(p);
+}
+
+QVector<quint64> CuMagic::latencyHistogram(LatencyStage stage) const {
+    QMutexLocker lo(&d->mu);
+    return d->lat[stage].buckets();
+}
+
+void CuMagic::resetLatency() {
+    QMutexLocker lo(&d->mu);
+    d->lat[LatencyDispatch].reset();
+    d->lat[LatencyWrite].reset();
+}
+
+// the source matched by replayed data: as given to setSource, without selectors
+QString CuMagic::m_replay_source() const {
+    return d->rq_src;
+}
+
+/*!
+ * \brief CuMagic::priority the priority of the updates of this magic, see CuMagicScheduler
+ *
+ * \li a visible widget: 2, plus 1 if its window is active and 2 if it or one of its children has focus
+ * \li a hidden widget: 0
+ * \li an object that is not a widget: 1
+ *
+ * The value of the *cumagic_priority* property of the target, if set, is added.
+ * The priority is cached while a scheduler is set, see CuMagicScheduler
+ */
+int CuMagic::priority() const {
+    if(!d->sched) // no events tracked
+        return m_priority();
+    if(d->prio < 0) // computed again after the events listed in eventFilter
+        d->prio = m_priority();
+    return d->prio;
+}
+
+int CuMagic::m_priority() const {
+    QObject *t = d->target;
+    QWidget *w = qobject_cast<QWidget *>(t);
+    int p = 1;
+    if(w && !w->isVisible())
+        p = 0;
+    else if(w) {
+        QWidget *f = w->focusWidget();
+        p = 2 + (w->isActiveWindow() ? 1 : 0) + (f && (f == w || w->isAncestorOf(f)) ? 2 : 0);
+    }
+    const QVariant& hint = t->property("cumagic_priority");
+    return hint.isValid() ? p + hint.toInt() : p;
+}
+
 void CuMagic::map(size_t idx, const QString &onam) {
-    qDebug() << __PRETTY_FUNCTION__ << "mapping index " << idx << "(" << onam << ") "<< "into object " << onam.section('/', 0, 0) <<
-                " / property " << onam.section('/', 1, 1);
-    QObject *o = parent()->findChild<QObject *>(onam.section('/', 0, 0));
+    QObject *o = d->target->findChild<QObject *>(onam.section('/', 0, 0));
+    d->bits_valid = false; // with a bit selector, write all the bits next time
+    d->str_src.clear(); // cached strings are valid for the mapped indexes only
     if(o) {
         if(d->omap.contains(onam))
             d->omap[onam].idxs.append(idx);
-        else
+        else {
             d->omap.insert(onam, opropinfo(o, onam.section('/', 1, 1), idx));
+            connect(o, SIGNAL(destroyed(QObject*)), this, SLOT(m_obj_destroyed(QObject*)), Qt::UniqueConnection);
+        }
+        if(d->lazy)
+            o->installEventFilter(this);
     }
     else perr("CuMagic.map: object \"%s\" not found among children of \"%s\" type %s", qstoc(onam),
-              qstoc(parent()->objectName()), parent()->metaObject()->className());
+              qstoc(d->target->objectName()), d->target->metaObject()->className());
 }
 
 void CuMagic::map(size_t idx, QObject *obj, const QString& prop) {
+    d->bits_valid = false;
+    d->str_src.clear();
     if(obj->objectName().isEmpty())
         perr("CuMagic.map: error: object %p has no name", obj);
     else if(d->omap.contains(obj->objectName()))
         d->omap[obj->objectName()].idxs.append(idx);
-    else
+    else {
         d->omap.insert(obj->objectName(), opropinfo(obj, prop, idx));
+        connect(obj, SIGNAL(destroyed(QObject*)), this, SLOT(m_obj_destroyed(QObject*)), Qt::UniqueConnection);
+    }
+    if(d->lazy && !obj->objectName().isEmpty())
+        obj->installEventFilter(this);
 }
 
 opropinfo &CuMagic::find(const QString &onam) {
@@ -125,6 +625,7 @@ opropinfo &CuMagic::find(const QString &onam) {
 
 void CuMagic::mapProperty(const QString &from, const QString &to) {
     d->propmap[from] = to;
+    d->bindings.clear();
 }
 
 QString CuMagic::propMappedFrom(const char *to) {
@@ -140,15 +641,38 @@ void CuMagic::sendData(const CuData &da) {
 }
 
 void CuMagic::setSource(const QString &src) {
-    const QString &s = m_get_idxs(src); // s has "\[([\d,\-]+)\]" removed
-    qDebug() << __PRETTY_FUNCTION__ << src << "-->" << s << "idxs" << d->v_idxs << d->omap.keys();
+    const QString &s = m_get_idxs(m_get_roi(m_get_bits(src))); // s has "\[([\d,\-]+)\]", region of interest and bits removed
+    if(!d->bits.isEmpty() && !d->v_idxs.isEmpty()) {
+        perr("CuMagic.setSource: \"%s\": index selector ignored with the bit selector", qstoc(src));
+        d->v_idxs.clear();
+    }
+    {
+        QMutexLocker lo(&d->mu);
+        d->rq_src = s;
+        d->lat_e = d->latency && !s.isEmpty() ? d->latency->entry(s) : nullptr;
+    }
+    if(d->capture)
+        d->capture->sourceChanged();
+    if(d->lazy && !m_shown()) { // connect when shown, see eventFilter
+        if(s != d->src) {
+            d->context->disposeReader();
+            d->src.clear();
+        }
+        d->lazy_src = s;
+    }
+    else
+        m_connect(s);
+}
+
+void CuMagic::m_connect(const QString &s) {
+    d->lazy_src.clear();
     // if indexes change but src is unchanged, do not d->context->replace_reader
     if(s != d->src) {
-        CuControlsReaderA *r = d->context->replace_reader(s.toStdString(), this);
+        CuDataListener *l = d->relay ? static_cast<CuDataListener *>(d->relay) : this;
+        CuControlsReaderA *r = d->context->replace_reader(s.toStdString(), l);
         if(r) {
             r->setSource(s);
             d->src = s; // bare src, not r->source
-            qDebug() << __PRETTY_FUNCTION__ << src << "-->" << r->source() << "idxs" << d->v_idxs << d->omap.keys();
         }
     }
 }
@@ -157,13 +681,135 @@ QString CuMagic::source() const {
     CuControlsReaderA *r = d->context->getReader();
     QString idx_selector = m_idxs_to_string();
     if(idx_selector.size()) idx_selector = "[" + idx_selector + "]";
+    if(d->roi.on) idx_selector += "[" + m_roi_to_string() + "]";
+    if(!d->bits.isEmpty()) idx_selector += "[bit:" + m_ranges_to_string(d->bits) + "]";
+    if(r == nullptr && !d->lazy_src.isEmpty()) // not connected yet
+        return d->lazy_src + idx_selector;
     return  r != nullptr ? r->source() + idx_selector : "";
 }
 
 void CuMagic::unsetSource() {
+    d->lazy_src.clear();
+    if(d->hide_timer)
+        d->hide_timer->stop();
     d->context->disposeReader(); // empty arg: dispose all
 }
 
+/*!
+ * \brief CuMagic::setAdaptivePeriod lengthen the polling period while the value does not change
+ * \param maxPeriodMs the longest period, in milliseconds. 0 disables the adaptive period (default)
+ * \param unchanged the number of equal values in a row after which the period is doubled
+ */
+void CuMagic::setAdaptivePeriod(int maxPeriodMs, int unchanged) {
+    d->adapt_max = std::max(maxPeriodMs, 0);
+    d->adapt_n = std::max(unchanged, 1);
+    d->adapt_same = 0;
+    d->adapt_last = CuVariant();
+    if(d->adapt_max == 0 && d->period > m_base_period())
+        m_set_period(m_base_period());
+}
+
+/*!
+ * \brief CuMagic::setThresholds warning and alarm limits, NaN if not used. They override the limits in the configuration
+ * \param hysteresis the margin within the limits required to return to a lower state
+ */
+void CuMagic::setThresholds(double minWarning, double maxWarning, double minAlarm, double maxAlarm, double hysteresis) {
+    d->thr.min_w = minWarning;
+    d->thr.max_w = maxWarning;
+    d->thr.min_a = minAlarm;
+    d->thr.max_a = maxAlarm;
+    d->thr.hyst = std::max(hysteresis, 0.0);
+}
+
+/*!
+ * \brief CuMagic::setAlarmStyleSheet style sheet set on widget targets when they enter state
+ */
+void CuMagic::setAlarmStyleSheet(AlarmState state, const QString &styleSheet) {
+    if(state >= StateValid && state <= StateAlarm)
+        d->alarm_css[state] = styleSheet;
+}
+
+CuMagicI::AlarmState CuMagic::alarmState(QObject *target) const {
+    return static_cast<AlarmState>(d->alarm_states.value(target ? target : d->target.data(), StateValid));
+}
+
+/*!
+ * \brief CuMagic::setLazyConnect connect to the source when the target or a mapped object is shown
+ * \param lazy true: the reader is created the first time one of the target widgets is shown.
+ * \param disconnectAfterMs if greater than zero, the reader is disposed when all the target widgets have
+ *        been hidden for this time, and created again when one is shown
+ *
+ * Targets that are not widgets are connected immediately
+ */
+void CuMagic::setLazyConnect(bool lazy, int disconnectAfterMs) {
+    d->lazy = lazy;
+    d->hide_ms = lazy ? disconnectAfterMs : 0;
+    foreach(QObject *o, m_targets())
+        if(lazy)
+            o->installEventFilter(this);
+        else if(o != d->target || !d->sched) // the scheduler needs the target events
+            o->removeEventFilter(this);
+    if(!lazy && !d->lazy_src.isEmpty())
+        m_connect(d->lazy_src);
+}
+
+bool CuMagic::eventFilter(QObject *o, QEvent *e) {
+    const QEvent::Type et = e->type();
+    if(o == d->target && (et == QEvent::Show || et == QEvent::Hide || et == QEvent::WindowActivate
+                          || et == QEvent::WindowDeactivate || et == QEvent::DynamicPropertyChange))
+        d->prio = -1;
+    if(e->type() == QEvent::Show) {
+        if(d->hide_timer)
+            d->hide_timer->stop();
+        if(!d->lazy_src.isEmpty())
+            m_connect(d->lazy_src);
+    }
+    else if(e->type() == QEvent::Hide && d->hide_ms > 0 && !d->src.isEmpty()) {
+        if(!d->hide_timer) {
+            d->hide_timer = new QTimer(this);
+            d->hide_timer->setSingleShot(true);
+            connect(d->hide_timer, SIGNAL(timeout()), this, SLOT(m_hidden_timeout()));
+        }
+        d->hide_timer->start(d->hide_ms);
+    }
+    return QObject::eventFilter(o, e);
+}
+
+void CuMagic::m_priority_changed() {
+    d->prio = -1;
+}
+
+void CuMagic::m_hidden_timeout() {
+    if(!m_shown() && !d->src.isEmpty()) {
+        d->lazy_src = d->src;
+        d->context->disposeReader();
+        d->src.clear();
+    }
+}
+
+// the target and the mapped objects
+QList<QObject *> CuMagic::m_targets() const {
+    QList<QObject *> objs;
+    objs << d->target;
+    foreach(const opropinfo& oi, d->omap.values())
+        objs << oi.obj;
+    return objs;
+}
+
+// true if one of the target widgets is visible or if no target is a widget
+bool CuMagic::m_shown() const {
+    bool widgets = false;
+    if(d->headless)
+        return true;
+    foreach(QObject *o, m_targets()) {
+        QWidget *w = qobject_cast<QWidget *>(o);
+        if(w && w->isVisible())
+            return true;
+        widgets |= w != nullptr;
+    }
+    return !widgets;
+}
+
 /** \brief returns a reference to this object, so that it can be used as a QObject
  *         to benefit from signal/slot connections.
  *
@@ -173,10 +819,58 @@ const QObject *CuMagicPlugin::get_qobject() const {
 }
 
 void CuMagic::onUpdate(const CuData &data) {
+    if(d->capture && d->capture->recording())
+        d->capture->record(d->rq_src, data);
+    const bool err = data[CuDType::Err].toBool();  // data["err"]
+    if(d->backoff_max > 0)
+        m_backoff(err);
+    if(d->adapt_max > 0 && !err && data[CuDType::Value].isValid())  // data["value"]
+        m_adapt_period(data[CuDType::Value]);
+    if(d->headless && thread() != d->ctx_thread) {
+        // apply in the target's thread, whatever is queued when it gets there. The context stays here
+        QMutexLocker lo(&d->mu);
+        d->queue.append(data);
+        if(d->queue.size() == 1)
+            QMetaObject::invokeMethod(this, "m_apply_queued", Qt::QueuedConnection);
+        lo.unlock();
+        if(d->onetime)
+            unsetSource();
+    }
+    else if(d->sched && d->sched->budget() > 0)
+        d->sched->schedule(this, data);
+    else // no budget: as soon as it arrives
+        m_apply(data);
+}
+
+// wall clock, microseconds since the epoch, as the data timestamps
+static qint64 m_now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return static_cast<qint64>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+// headless: apply the data queued by onUpdate, in the thread of the target
+void CuMagic::m_apply_queued() {
+    QList<CuData> q;
+    d->mu.lock();
+    q.swap(d->queue);
+    d->mu.unlock();
+    foreach(const CuData& da, q)
+        m_apply(da);
+}
+
+// the source given to setSource, from any thread
+QString CuMagic::m_src() const {
+    QMutexLocker lo(&d->mu);
+    return d->rq_src;
+}
+
+void CuMagic::m_apply(const CuData &data) {
+    if(!d->target)
+        return;
+    const qint64 ts_us = CuMagicI::timestamp_us(data), t0_us = ts_us > 0 ? m_now_us() : 0;
     bool err = data[CuDType::Err].toBool();  // data["err"]
-    const std::string& m = data.s(CuDType::Message);  // data.s("msg")
-    std::string msg = source().toStdString();
-    if(m.length() > 0) msg += "\n" + data[CuDType::Message].toString();  // data["msg"]
+    std::string msg = data.s(CuDType::Message);  // data.s("msg")
     const CuVariant &dv = data[CuDType::Value];  // data["value"]
     const CuVariant &v = dv.isValid() ? dv : d->on_error_value;
 
@@ -184,85 +878,65 @@ void CuMagic::onUpdate(const CuData &data) {
         m_configure(data);
     }
 
-    if(!err && d->omap.size() > 0) {
+    if(!d->bits.isEmpty()) {
+        m_set_bits(v, msg, err);
+    }
+    else if(d->omap.size() > 0) {
         CuVariant::DataType dt = v.getType();
         QMap<QString, CuVariant> vgroup;
-        switch(dt) {
-        case CuVariant::Double:
-            err = !m_v_split<double>(v, d->omap, vgroup);
-            break;
-        case CuVariant::Float:
-            err = !m_v_split<float>(v, d->omap, vgroup);
-            break;
-        case CuVariant::Int:
-            err = !m_v_split<int>(v, d->omap, vgroup);
-            break;
-        case CuVariant::LongInt:
-            err = !m_v_split<long int>(v, d->omap, vgroup);
-            break;
-        case CuVariant::LongLongInt:
-            err = !m_v_split<long long int>(v, d->omap, vgroup);
-            break;
-        case CuVariant::UInt:
-            err = !m_v_split<unsigned int>(v, d->omap, vgroup);
-            break;
-        case CuVariant::LongUInt:
-            err = !m_v_split<unsigned long int>(v, d->omap, vgroup);
-            break;
-        case CuVariant::LongLongUInt:
-            err = !m_v_split<unsigned long long int>(v, d->omap, vgroup);
-            break;
-        case CuVariant::Char:
-            err = !m_v_split<char>(v, d->omap, vgroup);
-            break;
-        case CuVariant::UChar:
-            err = !m_v_split<unsigned char>(v, d->omap, vgroup);
-            break;
-        case CuVariant::Short:
-            err = !m_v_split<short>(v, d->omap, vgroup);
-            break;
-        case CuVariant::UShort:
-            err = !m_v_split<unsigned short>(v, d->omap, vgroup);
-            break;
-        case CuVariant::LongDouble:
-            err = !m_v_split<long double>(v, d->omap, vgroup);
-            break;
-        case CuVariant::Boolean:
-            err = !m_v_split<bool>(v, d->omap, vgroup);
-            break;
-        case CuVariant::String:
-            err = !m_v_str_split(v, d->omap, vgroup);
-            break;
-        case CuVariant::VoidPtr:
-        case CuVariant::TypeInvalid:
-        case CuVariant::EndDataTypes:
-        case CuVariant::EndVariantTypes:
+        QMap<QString, QStringList> sgroup; // strings go straight to QString, see m_v_str_split
+        CuMagicSplitter split = dt >= 0 && dt < CuVariant::EndDataTypes ? m_dispatch().split[dt] : nullptr;
+        if(!err && dt == CuVariant::String)
+            err = !m_v_str_split(v, d->omap, sgroup);
+        else if(!err && split)
+            err = !(this->*split)(v, d->omap, vgroup);
+        else if(!err) {
             err = true;
             msg = "CuMagic.onUpdate: unsupported type \"" + v.dataTypeStr(dt) + "\"";
-            break;
-
         }
         foreach(const QString& onam, d->omap.keys()) {
             const opropinfo &opropi = d->omap[onam];
-            if(!err) err = !m_prop_set(opropi.obj, vgroup[onam], opropi.prop);
-            m_err_msg_set(opropi.obj, opropi.idxs, opropi.prop, msg.c_str(), err);
+            if(!err && dt == CuVariant::String)
+                err = !m_strlist_set(opropi.obj, sgroup[onam], opropi.prop);
+            else if(!err)
+                err = !m_prop_set(opropi.obj, vgroup[onam], opropi.prop);
+            m_err_msg_set(opropi.obj, opropi.idxs, opropi.prop, msg, err);
         }
     }
-    else if(!err) {
-        cuprintf("\e[0;33mcalling m_prop set wit v %s prop %s\e[0m\n", v.toString().c_str(), qstoc(d->t_prop));
-        err = !m_prop_set(parent(), v, d->t_prop);
-        m_err_msg_set(parent(), d->v_idxs, d->t_prop, msg.c_str(), err);
+    else {
+        if(!err)
+            err = !m_prop_set(d->target, v, d->t_prop);
+        m_err_msg_set(d->target, d->v_idxs, d->t_prop, msg, err);
     }
 
+    // latency from the data timestamp to dispatch start and to the end of the writes.
+    // Not while replaying: replayed data carries the recorded timestamps
+    if(ts_us > 0 && !(d->capture && d->capture->replaying())) {
+        const qint64 t1_us = m_now_us();
+        CuMagicLatency::Entry *e;
+        {
+            QMutexLocker lo(&d->mu);
+            d->lat[CuMagicI::LatencyDispatch].record(t0_us - ts_us);
+            d->lat[CuMagicI::LatencyWrite].record(t1_us - ts_us);
+            e = d->lat_e;
+        }
+        if(e)
+            CuMagicLatency::record(e, t0_us - ts_us, t1_us - ts_us);
+    }
+    if(dv.isValid() && !data[CuDType::Err].toBool() && d->bits.isEmpty() && (d->thr.on() || d->thr_cfg.on()))  // data["err"]
+        m_alarm_eval(dv);
+    if(d->shm && d->shm->active())
+        d->shm->publish(m_src(), data);
     emit newData(data);
     if(d->onetime) {
-        unsetSource();
+        if(thread() == d->ctx_thread) // otherwise done by onUpdate
+            unsetSource();
         deleteLater();
     }
 }
 
 QObject *CuMagic::get_target_object() const {
-    return parent();
+    return d->target;
 }
 
 CuContext *CuMagic::getContext() const {
@@ -270,375 +944,653 @@ CuContext *CuMagic::getContext() const {
 }
 
 QString CuMagic::format() const {
+    QMutexLocker lo(&d->mu);
     return d->format;
 }
 
 QString CuMagic::display_unit() const {
+    QMutexLocker lo(&d->mu);
     return d->display_unit;
 }
 
 
+/*
+ * the binding between a property of t and the data type and format of v is resolved the
+ * first time and whenever type or format change. Afterwards, the value is converted and
+ * set through one call to the resolved setter
+ */
 bool CuMagic::m_prop_set(QObject *t, const CuVariant &v, const QString &prop)
 {
+    CuMagicBinding &b = d->bindings[qMakePair(static_cast<const QObject *>(t), prop)];
+    if(!b.set || b.dt != v.getType() || b.fmt != v.getFormat())
+        m_bind(t, v, prop, b);
+    bool converted = (this->*b.set)(t, v, b);
+    if(!converted)
+        perr("CuMagic.m_prop_set: failed to set value %s on any of properties {%s} on %s",
+             v.toString().c_str(), b.prop.data(), qstoc(t->objectName()));
+    else if(!d->display_unit.isEmpty())
+        m_unit_set(t, b);
+    return converted;
+}
+
+/*
+ * find the property of t to use (prop or one among the defaults), its kind, and pick the
+ * setter for the data type of v from the dispatch table
+ */
+void CuMagic::m_bind(QObject *t, const CuVariant &v, const QString &prop, CuMagicBinding &b) {
     QStringList props;
-    bool converted = false, unsupported_type = false;
-    QVariant qva;
-    const CuVariant::DataFormat fmt = v.getFormat();
-    QString con_p = ""; // property name on which setProperty succeeded
     prop.isEmpty() ?  props <<  d->propmap.value("value", "value")
                              << d->propmap.value("checked", "checked")
                              << d->propmap.value("text", "text")
                                 : props << prop;
-    qDebug() << __PRETTY_FUNCTION__ << props;
-    int pi = -1;
-    for(int i = 0; i < props.size() && pi < 0; i++) {
-        const QString& qprop = props[i];
-        pi = t->metaObject()->indexOfProperty(qprop.toLatin1().data());
-        if(fmt == CuVariant::Matrix) {
-            QVariant var;
-            switch (v.getType()) {
-            case CuVariant::Double: {
-                CuMatrix<double> md = v.toMatrix<double>();
-                var.setValue(md);
-                t->setProperty(qprop.toLatin1(), var);
-            }break;
-            case CuVariant::LongDouble: {
-                CuMatrix<long double> mld = v.toMatrix<long double>();
-                var.setValue(mld);
-            }break;
-            case CuVariant::Float: {
-                CuMatrix<float>mf = v.toMatrix<float>();
-                var.setValue(mf);
-            }break;
-            case CuVariant::Int: {
-                CuMatrix<int>mi = v.toMatrix<int>();
-                var.setValue(mi);
-            }break;
-            case CuVariant::Char: {
-                CuMatrix<char>mch = v.toMatrix<char>();
-                var.setValue(mch);
-            }break;
-            case CuVariant::UChar: {
-                CuMatrix<unsigned char>much = v.toMatrix<unsigned char>();
-                var.setValue(much);
-            }break;
-            case CuVariant::UShort: {
-                CuMatrix<unsigned short int> mus = v.toMatrix<unsigned short int>();
-                var.setValue(mus);
-            }break;
-            case CuVariant::Short: {
-                CuMatrix<short>ms = v.toMatrix<short>();
-                var.setValue(ms);
-            }break;
-            case CuVariant::UInt: {
-                CuMatrix<unsigned int>mui = v.toMatrix<unsigned int>();
-                var.setValue(mui);
-            }break;
-            case CuVariant::LongUInt: {
-                CuMatrix<long unsigned int>muli = v.toMatrix<long unsigned int>();
-                var.setValue(muli);
-            }break;
-            case CuVariant::LongLongUInt: {
-                CuMatrix<long long unsigned int>mulli = v.toMatrix<long long unsigned int>();
-                var.setValue(mulli);
-            }break;
-            case CuVariant::LongLongInt: {
-                CuMatrix<long long int>mlli = v.toMatrix<long long int>();
-                var.setValue(mlli);
-            }break;
-            case CuVariant::LongInt: {
-                CuMatrix<long int>mli = v.toMatrix<long int>();
-                var.setValue(mli);
-            }break;
-            case CuVariant::Boolean: {
-                CuMatrix<bool> mabo = v.toMatrix<bool>();
-                var.setValue(mabo);
-            }break;
-            case CuVariant::String: {
-                CuMatrix<std::string> mas = v.toMatrix<std::string>();
-                var.setValue(mas);
-            }break;
-            case CuVariant::TypeInvalid:
-                break;
-            default:
-                perr("CuMagic::m_prop_set: cannot convert type %d (%s) to matrix", v.getType(), v.dataTypeStr(v.getType()).c_str());
-                break;
-            } // switch (v.getType())
-            if(var.isValid())
-                t->setProperty(qprop.toLatin1(), var);
-        } // end matrix format
-        else if(pi > -1 && !converted && (fmt == CuVariant::Scalar || fmt == CuVariant::Vector))  {
-            QMetaProperty mp = t->metaObject()->property(pi);
-            if(strcmp(mp.typeName(), "QVector<double>") == 0) {
-                qva = m_convert<double>(v, Vector);
-            }
-            else if(strcmp(mp.typeName(), "QList<double>") == 0) {
-                qva = m_convert<double>(v, List);
-            }
-            else if(strcmp(mp.typeName(), "QVector<int>") == 0) {
-                qva = m_convert<int>(v, Vector);
-            }
-            else if(strcmp(mp.typeName(), "QList<int>") == 0) {
-                qva = m_convert<int>(v, List);
-            }
-            else {
+    b.dt = v.getType();
+    b.fmt = v.getFormat();
+    b.pi = -1;
+    b.range_mi = -1;
+    b.last = QVariant();
+    for(int i = 0; i < props.size() && b.pi < 0; i++) {
+        b.prop = props[i].toLatin1();
+        b.pi = t->metaObject()->indexOfProperty(b.prop.data());
+    }
+    if(b.fmt == CuVariant::Matrix && prop.isEmpty() && qobject_cast<QLabel *>(t))
+        b.tk = TkLabel; // image on the label pixmap
+    else if(b.pi < 0 && prop.isEmpty()) { // dynamic properties are added only if explicitly named
+        b.tk = TkInvalid;
+        b.prop = props.join(",").toLatin1();
+    }
+    else if(b.fmt == CuVariant::Matrix) {
+        const char *tn = b.pi < 0 ? "" : t->metaObject()->property(b.pi).typeName();
+        b.tk = strcmp(tn, "QImage") == 0 ? TkImage : strcmp(tn, "QPixmap") == 0 ? TkPixmap : TkMatrix;
+        if(b.tk == TkMatrix && b.pi > -1 && b.dt >= 0 && b.dt < CuVariant::EndDataTypes) {
+            // CuMatrix<D> property: convert the elements while copying
+            const QMetaProperty& mp = t->metaObject()->property(b.pi);
 #if QT_VERSION >= QT_VERSION_CHECK(6,0,0)
-                switch(mp.metaType().id())
+            const int ddt = m_dispatch().mx_types.value(mp.metaType().id(), -1);
 #else
-                switch(mp.userType()) // equivalent to qt6's metaType.id()
+            const int ddt = m_dispatch().mx_types.value(mp.userType(), -1);
 #endif
-                {
-                case QMetaType::Int: {
-                    qva = m_convert<int>(v);
-                } break;
-                case QMetaType::LongLong:
-                case QMetaType::Long: {
-                    qva = m_convert<long long int>(v);
-                } break;
-                case QMetaType::UInt:
-                case QMetaType::UShort:
-                case QMetaType::UChar: {
-                    qva = m_convert<unsigned int>(v);
-                } break;
-                case QMetaType::ULongLong:
-                case QMetaType::ULong: {
-                    qva = m_convert<unsigned long long>(v);
-                } break;
-                case QMetaType::Double:
-                case QMetaType::Float: {
-                    qva = m_convert<double>(v);
-                } break;
-                case QMetaType::Bool: {
-                    qva = m_convert<bool>(v);
-                } break;
-                case QMetaType::QString: {
-                    qva = m_str_convert(v);
-                } break;
-                case QMetaType::QStringList: {
-                    qva = QuStringList(v);
-                } break;
-                default:
-                    unsupported_type = true;
-                    break;
-                } // switch
-            }
-            if(!unsupported_type && qva.isValid()) {
-                converted |= t->setProperty(qprop.toLatin1().data(), qva);
-                if(converted) con_p = qprop;
+            if(ddt > -1 && m_dispatch().mx[b.dt][ddt]) {
+                b.set = m_dispatch().mx[b.dt][ddt];
+                return;
             }
         }
-        else if(pi < 0 && !converted && !prop.isEmpty()) {
-            cuprintf("CuMagic::m_prop_set \e[1;32m HAS NO PROPERY DEFINED SO SETTING FREEEEEEEEEEEEEEEEEEEEEEEEEEEEEEEEEEEE\e[0m\n");
-            CuVariant::DataType ty = v.getType();
-            switch(v.getFormat()) {
-            case CuVariant::Scalar: {
-                converted = true; // cannot use the return value of setProperty: it is false for dynamic props
-                switch(ty) {
-                case CuVariant::Double:
-                case CuVariant::LongDouble: {
-                    double dou;
-                    v.to<double>(dou);
-                    cuprintf("CuMagic::m_prop_set %s DOUBLE! %f\n", qprop.toLatin1().data(),   dou);
-                    t->setProperty(qprop.toLatin1(), dou);
-                    cuprintf("CuMagic::m_prop_set DOUBLE readback %f\n", t->property(qprop.toLatin1()).toDouble());
-                }break;
-                case CuVariant::Float:
-                    t->setProperty(qprop.toLatin1(), v.toFloat());
-                    break;
-                case CuVariant::Int:
-                    t->setProperty(qprop.toLatin1(), v.toInt());
-                    break;
-                case CuVariant::Short:
-                    t->setProperty(qprop.toLatin1(), v.toShortInt());
-                    break;
-                case CuVariant::UInt:
-                    t->setProperty(qprop.toLatin1(), v.toUInt());
-                    break;
-                case CuVariant::LongUInt:
-                case CuVariant::LongLongUInt: {
-                    long long unsigned ll = 0;
-                    v.to<long long unsigned>(ll);
-                    t->setProperty(qprop.toLatin1(), ll);
-                }break;
-                case CuVariant::LongLongInt:
-                case CuVariant::LongInt: {
-                    long long int lli = 0;
-                    v.to<long long int>(lli);
-                    t->setProperty(qprop.toLatin1(), lli);
-                } break;
-                case CuVariant::UShort:
-                    t->setProperty(qprop.toLatin1(), v.toUShortInt());
-                    break;
-                case CuVariant::Boolean: {
-                    bool b;
-                    v.to<bool>(b);
-                    t->setProperty(qprop.toLatin1(), b);
-                }break;
-                case CuVariant::String:
-                    t->setProperty(qprop.toLatin1(), QString::fromStdString(v.toString()));
-                    break;
-
-                default:
-                    converted = false;
-                    break;
-
-                }break;
-            case CuVariant::Vector: {
-                    converted = true; // see scalar above
-                    switch(ty) {
-                    case CuVariant::Double:
-                    case CuVariant::LongDouble: {
-                        std::vector<double> vdou;
-                        v.toVector<double>(vdou);
-#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
-                        QVariantList vl (vdou.begin(), vdou.end());
-#else
-                        QVariantList vl;
-                        foreach(double d, vdou)
-                            vl << d;
-#endif
-                        converted = t->setProperty(qprop.toLatin1(), vl);
-                    }break;
-                    case CuVariant::Float: {
-                        std::vector<float> vf;
-                        v.toVector<float>(vf);
-#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
-                        QVariantList vl (vf.begin(), vf.end());
-#else
-                        QVariantList vl;
-                        foreach(float f, vf)
-                            vl << f;
-#endif
-                        converted = t->setProperty(qprop.toLatin1(), vl);
-                    }break;
-                    case CuVariant::Int: {
-                        std::vector<int> vi;
-                        v.toVector<int>(vi);
-#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
-                        QVariantList vl (vi.begin(), vi.end());
-#else
-                        QVariantList vl;
-                        foreach(int i, vi)
-                            vl << i;
-#endif
-                        converted = t->setProperty(qprop.toLatin1(), vl);
-                    }break;
-                    case CuVariant::Short: {
-                        std::vector<short> vsi;
-                        v.toVector<short>(vsi);
-#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
-                        QVariantList vl (vsi.begin(), vsi.end());
-#else
-                        QVariantList vl;
-                        foreach(short si, vsi)
-                            vl << si;
-#endif
-                        converted = t->setProperty(qprop.toLatin1(), vl);
-                    }break;
-                    case CuVariant::UInt: {
-                        std::vector<unsigned> vui;
-                        v.toVector<unsigned>(vui);
-#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
-                        QVariantList vl (vui.begin(), vui.end());
-#else
-                        QVariantList vl;
-                        foreach(unsigned ui, vui)
-                            vl << ui;
-#endif
-                        converted = t->setProperty(qprop.toLatin1(), vl);
-                    }break;
-                    case CuVariant::LongUInt:
-                    case CuVariant::LongLongUInt: {
-                        std::vector<unsigned long long> vull;
-                        v.toVector<unsigned long long>(vull);
-#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
-                        QVariantList vl (vull.begin(), vull.end());
-#else
-                        QVariantList vl;
-                        foreach(unsigned long long ulli, vull)
-                            vl << ulli;
-#endif
-                        converted = t->setProperty(qprop.toLatin1(), vl);
-                    }break;
-                    case CuVariant::LongLongInt:
-                    case CuVariant::LongInt: {
-                        std::vector< long long> vll;
-                        v.toVector< long long>(vll);
-#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
-                        QVariantList vl (vll.begin(), vll.end());
-#else
-                        QVariantList vl;
-                        foreach(unsigned long long lli, vll)
-                            vl << lli;
-#endif
-                        converted = t->setProperty(qprop.toLatin1(), vl);
-                    }break;
-                    case CuVariant::UShort: {
-                        std::vector<unsigned short> vus;
-                        v.toVector<unsigned short>(vus);
-#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
-                        QVariantList vl (vus.begin(), vus.end());
+    }
+    else if(b.pi < 0)
+        b.tk = b.fmt == CuVariant::Scalar ? TkDynScalar : b.fmt == CuVariant::Vector ? TkDynVector : TkInvalid;
+    else {
+        b.tk = m_target_kind(t->metaObject()->property(b.pi));
+        if(b.tk == TkVectorDouble || b.tk == TkListDouble)
+            b.range_mi = t->metaObject()->indexOfMethod("updateRange(int,QVector<double>)");
+        else if(b.tk == TkVectorInt || b.tk == TkListInt)
+            b.range_mi = t->metaObject()->indexOfMethod("updateRange(int,QVector<int>)");
+    }
+    b.set = b.dt >= 0 && b.dt < CuVariant::EndDataTypes ? m_dispatch().set[b.dt][b.tk] : &CuMagic::m_set_none;
+}
+
+CuMagic::TargetKind CuMagic::m_target_kind(const QMetaProperty &mp) {
+    if(strcmp(mp.typeName(), "QVector<double>") == 0)
+        return TkVectorDouble;
+    else if(strcmp(mp.typeName(), "QList<double>") == 0)
+        return TkListDouble;
+    else if(strcmp(mp.typeName(), "QVector<int>") == 0)
+        return TkVectorInt;
+    else if(strcmp(mp.typeName(), "QList<int>") == 0)
+        return TkListInt;
+#if QT_VERSION >= QT_VERSION_CHECK(6,0,0)
+    switch(mp.metaType().id())
 #else
-                        QVariantList vl;
-                        foreach(unsigned short us, vus)
-                            vl << us;
+    switch(mp.userType()) // equivalent to qt6's metaType.id()
 #endif
-                        converted = t->setProperty(qprop.toLatin1(), vl);
-                    }break;
-                    case CuVariant::Boolean: {
-                        std::vector<bool> vboo;
-                        v.toVector<bool>(vboo);
-                        QVariantList vl;
-                        foreach(bool b, vboo)
-                            vl.push_back(b);
-                        converted = t->setProperty(qprop.toLatin1(), vl);
-                    }break;
-                    case CuVariant::String:{
-                        QuStringList sl(v);
-                        converted = t->setProperty(qprop.toLatin1(), sl);
-                    }
-                        break;
-
-                    default:
-                        converted = false;
-                        break;
-                    } break;
-                case CuVariant::Matrix: {
-
-                    }break;
-                    default: // EndFormatTypes, FormatInvalid
-                        break;
-                    }
-                }
+    {
+    case QMetaType::Int:
+        return TkInt;
+    case QMetaType::LongLong:
+    case QMetaType::Long:
+        return TkLongLong;
+    case QMetaType::UInt:
+    case QMetaType::UShort:
+    case QMetaType::UChar:
+        return TkUInt;
+    case QMetaType::ULongLong:
+    case QMetaType::ULong:
+        return TkULongLong;
+    case QMetaType::Double:
+    case QMetaType::Float:
+        return TkDouble;
+    case QMetaType::Bool:
+        return TkBool;
+    case QMetaType::QString:
+        return TkString;
+    case QMetaType::QStringList:
+        return TkStringList;
+    default:
+        return TkInvalid;
+    }
+}
+
+// if the object has a *suffix* property, the display unit goes there. Otherwise it is appended to strings
+void CuMagic::m_unit_set(QObject *t, const CuMagicBinding &b) {
+    const QMetaObject *mo = t->metaObject();
+    if(mo->indexOfProperty("suffix") > -1 &&
+            (mo->indexOfProperty("displayUnitEnabled") < 0 || t->property("displayUnitEnabled").toBool()) ) {
+        const QString& suffix = " [" + d->display_unit + "]";
+        if(t->property("suffix").toString() != suffix)
+            t->setProperty("suffix", suffix);
+    }
+    else if(b.tk == TkString)
+        t->setProperty(b.prop.data(), t->property(b.prop.data()).toString() + " [" + d->display_unit + "]");
+}
+
+/*
+ * min/max decimation: the n values are split into np / 2 buckets and the minimum and the
+ * maximum of each bucket are kept, in index order, so that peaks stay visible. One pass over
+ * the storage of v. x receives the index of each value kept
+ */
+template <typename T> bool CuMagic::m_decimate(const CuVariant &v, size_t np, std::vector<double> &x, std::vector<double> &y) {
+    const T *p = static_cast<const T *>(v.data());
+    const size_t n = v.getSize(), nb = np / 2;
+    if(!p)
+        return false;
+    x.clear();
+    y.clear();
+    if(n <= np || nb == 0) { // nothing to decimate (or unknown target width)
+        x.resize(n);
+        y.resize(n);
+        for(size_t i = 0; i < n; i++) {
+            x[i] = i;
+            y[i] = static_cast<double>(p[i]);
+        }
+        return true;
+    }
+    x.reserve(2 * nb);
+    y.reserve(2 * nb);
+    for(size_t bk = 0; bk < nb; bk++) {
+        const size_t a = bk * n / nb, e = (bk + 1) * n / nb;
+        size_t imin = a, imax = a;
+        for(size_t i = a + 1; i < e; i++) {
+            imin = p[i] < p[imin] ? i : imin;
+            imax = p[i] > p[imax] ? i : imax;
+        }
+        const size_t i0 = std::min(imin, imax), i1 = std::max(imin, imax);
+        x.push_back(i0);
+        y.push_back(static_cast<double>(p[i0]));
+        if(i1 != i0) {
+            x.push_back(i1);
+            y.push_back(static_cast<double>(p[i1]));
+        }
+    }
+    return true;
+}
+
+/*
+ * decimated vector on the target. Indexes of the values are set on the property mapped from "x",
+ * if any, before the values, so that the target finds the matching x when y changes
+ */
+template <typename T, int tdt> bool CuMagic::m_set_decimated(QObject *t, const CuVariant &v, CuMagicBinding &b) {
+    QWidget *w = qobject_cast<QWidget *>(t);
+    const size_t np = d->decim > 0 ? d->decim : (w ? 2 * w->width() : 0);
+    CuMagicDecimator dec = m_dispatch().decim[v.getType()];
+    std::vector<double> x, y;
+    if(!dec || !(this->*dec)(v, np, x, y))
+        return false;
+    m_transform(y);
+    QVector<T> vy(static_cast<int>(y.size()));
+    for(int i = 0; i < vy.size(); i++)
+        vy[i] = m_cast<T>(y[i]);
+    if(d->propmap.contains("x")) {
+        QVector<double> vx(static_cast<int>(x.size()));
+        std::copy(x.begin(), x.end(), vx.begin());
+        t->setProperty(d->propmap["x"].toLatin1().data(), tdt == Vector ? QVariant::fromValue(vx) : QVariant::fromValue(vx.toList()));
+    }
+    return t->setProperty(b.prop.data(), tdt == Vector ? QVariant::fromValue(vy) : QVariant::fromValue(vy.toList()));
+}
+
+template <typename T, int tdt> bool CuMagic::m_set_conv(QObject *t, const CuVariant &v, CuMagicBinding &b) {
+    if(tdt != Scalar && d->decim != 0 && d->v_idxs.isEmpty() && v.getFormat() == CuVariant::Vector
+            && v.getType() >= 0 && v.getType() < CuVariant::EndDataTypes && m_dispatch().decim[v.getType()])
+        return m_set_decimated<T, tdt>(t, v, b);
+    const QVariant& qva = m_convert<T>(v, static_cast<TargetDataType>(tdt));
+    if(tdt != Scalar && b.range_mi > -1 && qva.isValid())
+        return m_set_ranges<T>(t, tdt == Vector ? qva.value<QVector<T> >() : qva.value<QList<T> >().toVector(), qva, b);
+    return qva.isValid() && t->setProperty(b.prop.data(), qva);
+}
+
+/*
+ * compare y with the vector last applied on t and call t's updateRange(int, QVector<T>) for each
+ * run of changed values. Runs separated by less than 8 unchanged values are merged into one call.
+ * The whole vector qva is set on the property if the size changes or too many values changed
+ */
+template <typename T> bool CuMagic::m_set_ranges(QObject *t, const QVector<T> &y, const QVariant &qva, CuMagicBinding &b) {
+    const QVector<T> old = b.last.value<QVector<T> >();
+    const int n = y.size(), gap = 8;
+    b.last = QVariant::fromValue(y);
+    if(old.size() != n || d->range_thr <= 0)
+        return t->setProperty(b.prop.data(), qva);
+    int nch = 0;
+    for(int i = 0; i < n; i++)
+        nch += y[i] != old[i];
+    if(nch == 0)
+        return true; // nothing changed
+    if(nch > d->range_thr * n)
+        return t->setProperty(b.prop.data(), qva);
+    const QMetaMethod& mm = t->metaObject()->method(b.range_mi);
+    bool ok = true;
+    for(int i = 0; i < n && ok; ) {
+        while(i < n && y[i] == old[i])
+            i++;
+        if(i == n)
+            break;
+        int e = i, j = i + 1;
+        for(; j < n && j - e <= gap; j++)
+            if(y[j] != old[j])
+                e = j;
+        ok = mm.invoke(t, Qt::DirectConnection, Q_ARG(int, i), Q_ARG(QVector<T>, y.mid(i, e - i + 1)));
+        i = e + 1;
+    }
+    if(!ok) {
+        perr("CuMagic.m_set_ranges: failed to invoke %s on %s: setting property \"%s\"",
+             mm.methodSignature().data(), qstoc(t->objectName()), b.prop.data());
+        return t->setProperty(b.prop.data(), qva);
+    }
+    return ok;
+}
+
+bool CuMagic::m_set_str(QObject *t, const CuVariant &v, CuMagicBinding &b) {
+    const QVariant& qva = m_str_convert(v);
+    return qva.isValid() && t->setProperty(b.prop.data(), qva);
+}
+
+bool CuMagic::m_set_strlist(QObject *t, const CuVariant &v, CuMagicBinding &b) {
+    return t->setProperty(b.prop.data(), QStringList(QuStringList(v)));
+}
+
+/*
+ * S: type of the data, D: element type of the CuMatrix property. Conversion from S to D,
+ * region of interest selection and binning all happen in the single copy made by m_bin
+ */
+template <typename S, typename D> bool CuMagic::m_set_matrix(QObject *t, const CuVariant &v, CuMagicBinding &b) {
+    const CuMatrix<S> *m = v.toMatrixPtr<S>();
+    size_t r0, r1, c0, c1, by, bx;
+    if(!m || !m_roi(m->nrows(), m->ncols(), r0, r1, c0, c1))
+        return false;
+    m_bin_factors(t, r1 - r0, c1 - c0, by, bx);
+    QVariant var;
+    if(std::is_same<S, D>::value && !d->roi.on && by == 1 && bx == 1)
+        var.setValue(*m);
+    else { // copy the region of interest only, binned and converted
+        std::vector<D> sel;
+        size_t nr, nc;
+        m_bin(*m, r0, r1, c0, c1, by, bx, d->bin_mode, sel, nr, nc);
+        var.setValue(CuMatrix<D>(sel, nr, nc));
+    }
+    return t->setProperty(b.prop.data(), var) || b.pi < 0; // false for dynamic properties
+}
+
+/*
+ * normalise a row of n values into [0, 255] and map them through the 256 entries
+ * colormap. The first loop is branch free and vectorizable, the second is a table lookup
+ */
+template <typename T> static void m_img_row(const T *src, uchar *ix, QRgb *dst, int n,
+                                            double lo, double k, const QRgb *lut) {
+    for(int c = 0; c < n; c++) {
+        double x = (static_cast<double>(src[c]) - lo) * k;
+        x = x < 0.0 ? 0.0 : x;
+        x = x > 255.0 ? 255.0 : x;
+        ix[c] = static_cast<uchar>(x);
+    }
+    for(int c = 0; c < n; c++)
+        dst[c] = lut[ix[c]];
+}
+
+/*
+ * reduce the region [r0, r1) x [c0, c1) of m by by x bx blocks in one pass over the rows,
+ * according to mode (CuMagicI::BinMode). Blocks at the right and bottom edges may be smaller.
+ * A 1 x 1 block copies the region
+ */
+template <typename T, typename O> static void m_bin(const CuMatrix<T> &m, size_t r0, size_t r1, size_t c0, size_t c1,
+                                                    size_t by, size_t bx, int mode,
+                                                    std::vector<O> &out, size_t &onr, size_t &onc) {
+    onr = (r1 - r0 + by - 1) / by;
+    onc = (c1 - c0 + bx - 1) / bx;
+    out.resize(onr * onc);
+    std::vector<double> acc(onc);
+    for(size_t orow = 0; orow < onr; orow++) {
+        const size_t ra = r0 + orow * by, rb = std::min(ra + by, r1);
+        if(mode == CuMagicI::BinSubsample || (by == 1 && bx == 1)) { // top left element of each block
+            const T *src = m[ra] + c0;
+            for(size_t oc = 0; oc < onc; oc++)
+                out[orow * onc + oc] = static_cast<O>(src[oc * bx]);
+            continue;
+        }
+        std::fill(acc.begin(), acc.end(), mode == CuMagicI::BinMax ? std::numeric_limits<double>::lowest() : 0.0);
+        for(size_t r = ra; r < rb; r++) {
+            const T *src = m[r] + c0;
+            for(size_t oc = 0; oc < onc; oc++) {
+                const size_t ca = oc * bx, cb = std::min(ca + bx, c1 - c0);
+                double a = acc[oc];
+                if(mode == CuMagicI::BinMax)
+                    for(size_t c = ca; c < cb; c++)
+                        a = std::max(a, static_cast<double>(src[c]));
+                else
+                    for(size_t c = ca; c < cb; c++)
+                        a += static_cast<double>(src[c]);
+                acc[oc] = a;
             }
-            if(!converted)
-                perr("CuMagic.m_prop_set: failed to set value %s on any of properties {%s} on %s",
-                     v.toString().c_str(), qstoc(props.join(",")), qstoc(t->objectName()));
-            else {
-                if(t->metaObject()->indexOfProperty("suffix") > -1 && !d->display_unit.isEmpty() &&
-                        (t->metaObject()->indexOfProperty("displayUnitEnabled") < 0 || t->property("displayUnitEnabled").toBool() ) )
-                    t->setProperty("suffix", " [" + d->display_unit + "]");
-                else if(!d->display_unit.isEmpty() && t->metaObject()->property(t->metaObject()->indexOfProperty(con_p.toLatin1())).type() == QVariant::String)
-                    t->setProperty(con_p.toLatin1(), t->property(con_p.toLatin1()).toString() + " [" + d->display_unit + "]");
+        }
+        for(size_t oc = 0; oc < onc; oc++) {
+            const size_t n = (rb - ra) * (std::min(oc * bx + bx, c1 - c0) - oc * bx);
+            out[orow * onc + oc] = static_cast<O>(mode == CuMagicI::BinMax ? acc[oc] : acc[oc] / n);
+        }
+    }
+}
+
+// strings can only be subsampled
+static void m_bin(const CuMatrix<std::string> &m, size_t r0, size_t r1, size_t c0, size_t c1,
+                  size_t by, size_t bx, int , std::vector<std::string> &out, size_t &onr, size_t &onc) {
+    onr = (r1 - r0 + by - 1) / by;
+    onc = (c1 - c0 + bx - 1) / bx;
+    out.resize(onr * onc);
+    for(size_t orow = 0; orow < onr; orow++)
+        for(size_t oc = 0; oc < onc; oc++)
+            out[orow * onc + oc] = m[r0 + orow * by][c0 + oc * bx];
+}
+
+// binning factors. 0 means: reduce to about the size of the target widget
+void CuMagic::m_bin_factors(QObject *t, size_t nr, size_t nc, size_t &by, size_t &bx) const {
+    QWidget *w = qobject_cast<QWidget *>(t);
+    by = d->bin_rows > 0 ? d->bin_rows : (w && w->height() > 0 ? std::max<size_t>(1, nr / w->height()) : 1);
+    bx = d->bin_cols > 0 ? d->bin_cols : (w && w->width() > 0 ? std::max<size_t>(1, nc / w->width()) : 1);
+}
 
+/*
+ * normalise and colormap nr rows of nc values into img. Rows are stride elements apart.
+ * img is reused across updates unless its size changes or it is still shared with the target
+ */
+template <typename T> void CuMagic::m_img_fill(const T *base, size_t stride, int nr, int nc, QImage &img) {
+    if(img.width() != nc || img.height() != nr || !img.isDetached())
+        img = QImage(nc, nr, QImage::Format_RGB32);
+    double lo = d->img_min, hi = d->img_max;
+    if(!(lo < hi)) { // auto scale
+        lo = std::numeric_limits<double>::max();
+        hi = std::numeric_limits<double>::lowest();
+        for(int r = 0; r < nr; r++) {
+            const T *src = base + r * stride;
+            for(int c = 0; c < nc; c++) {
+                const double x = static_cast<double>(src[c]);
+                lo = x < lo ? x : lo;
+                hi = x > hi ? x : hi;
             }
         }
     }
-    return converted;
+    const double k = hi > lo ? 255.0 / (hi - lo) : 0.0;
+    std::vector<uchar> ix(nc);
+    for(int r = 0; r < nr; r++)
+        m_img_row(base + r * stride, ix.data(), reinterpret_cast<QRgb *>(img.scanLine(r)), nc, lo, k, d->lut.constData());
+}
+
+/*
+ * write the matrix into img, straight from the data storage unless binning is required
+ */
+template <typename T> bool CuMagic::m_to_image(QObject *t, const CuVariant &v, QImage &img) {
+    const CuMatrix<T> *m = v.toMatrixPtr<T>();
+    size_t r0, r1, c0, c1, by, bx;
+    if(!m || !m_roi(m->nrows(), m->ncols(), r0, r1, c0, c1))
+        return false;
+    m_bin_factors(t, r1 - r0, c1 - c0, by, bx);
+    if(by > 1 || bx > 1) {
+        std::vector<double> binned;
+        size_t nr, nc;
+        m_bin(*m, r0, r1, c0, c1, by, bx, d->bin_mode, binned, nr, nc);
+        m_img_fill(binned.data(), nc, static_cast<int>(nr), static_cast<int>(nc), img);
+    }
+    else
+        m_img_fill((*m)[r0] + c0, m->ncols(), static_cast<int>(r1 - r0), static_cast<int>(c1 - c0), img);
+    return true;
+}
+
+template <typename T> bool CuMagic::m_set_image(QObject *t, const CuVariant &v, CuMagicBinding &b) {
+    if(!m_to_image<T>(t, v, b.image))
+        return false;
+    if(b.tk == TkLabel) {
+        qobject_cast<QLabel *>(t)->setPixmap(QPixmap::fromImage(b.image));
+        return true;
+    }
+    const QVariant& var = b.tk == TkPixmap ? QVariant::fromValue(QPixmap::fromImage(b.image)) : QVariant::fromValue(b.image);
+    return t->setProperty(b.prop.data(), var) || b.pi < 0;
+}
+
+template <typename T> bool CuMagic::m_set_dyn_scalar(QObject *t, const CuVariant &v, CuMagicBinding &b) {
+    T x;
+    if(!v.to<T>(x))
+        return false;
+    if(d->xform && !std::is_same<T, bool>::value) { // calibrated values are set as double
+        double xd = static_cast<double>(x);
+        m_transform(&xd, 1);
+        t->setProperty(b.prop.data(), xd);
+    }
+    else
+        t->setProperty(b.prop.data(), QVariant(x));
+    return true; // cannot use the return value of setProperty: it is false for dynamic props
+}
+
+template <typename T> static void m_to_vlist(const std::vector<T> &v, QVariantList &vl) {
+    vl.reserve(static_cast<int>(v.size()));
+    for(typename std::vector<T>::const_iterator it = v.begin(); it != v.end(); ++it)
+        vl.push_back(QVariant(static_cast<T>(*it)));
 }
 
-bool CuMagic::m_v_str_split(const CuVariant &in, const QMap<QString, opropinfo> &opropis, QMap<QString, CuVariant> &out) {
+// a QVector<T> or, in compatibility mode (see CuMagic::setDynamicVariantList), a QVariantList
+template <typename T> static QVariant m_dyn_var(const std::vector<T> &v, bool vlist) {
+    if(vlist) {
+        QVariantList vl;
+        m_to_vlist(v, vl);
+        return vl;
+    }
+    QVector<T> qv(static_cast<int>(v.size()));
+    std::copy(v.begin(), v.end(), qv.begin());
+    return QVariant::fromValue(qv);
+}
+
+/*
+ * S: the type of the data, D: the element type of the QVector<D> set on the property. Vectors are
+ * copied (and converted) once, from the storage of v into the packed QVector<D>
+ */
+template <typename S, typename D> bool CuMagic::m_set_dyn_vector(QObject *t, const CuVariant &v, CuMagicBinding &b) {
+    QVariant var;
+    if(d->xform && !std::is_same<D, bool>::value) { // see m_set_dyn_scalar
+        std::vector<double> vd;
+        if(!v.toVector<double>(vd))
+            return false;
+        m_transform(vd);
+        var = m_dyn_var(vd, d->dyn_vlist);
+    }
+    else if(!d->dyn_vlist && v.getFormat() == CuVariant::Vector && v.getSize() > 0) {
+        const S *p = static_cast<const S *>(v.data());
+        QVector<D> qv(static_cast<int>(v.getSize()));
+        std::copy(p, p + v.getSize(), qv.begin());
+        var = QVariant::fromValue(qv);
+    }
+    else {
+        std::vector<D> vt;
+        if(!v.toVector<D>(vt))
+            return false;
+        var = m_dyn_var(vt, d->dyn_vlist);
+    }
+    t->setProperty(b.prop.data(), var);
+    return true; // see m_set_dyn_scalar
+}
+
+bool CuMagic::m_set_dyn_str(QObject *t, const CuVariant &v, CuMagicBinding &b) {
+    t->setProperty(b.prop.data(), QString::fromStdString(v.toString()));
+    return true;
+}
+
+bool CuMagic::m_set_dyn_strlist(QObject *t, const CuVariant &v, CuMagicBinding &b) {
+    t->setProperty(b.prop.data(), QStringList(QuStringList(v)));
+    return true;
+}
+
+bool CuMagic::m_set_none(QObject *, const CuVariant &, CuMagicBinding &) {
+    return false;
+}
+
+CuMagicDispatch::CuMagicDispatch() {
+    for(int i = 0; i < CuVariant::EndDataTypes; i++) {
+        split[i] = nullptr;
+        decim[i] = nullptr;
+        for(int j = 0; j < CuVariant::EndDataTypes; j++)
+            mx[i][j] = nullptr;
+        for(int j = 0; j < CuMagic::TkEndKinds; j++)
+            set[i][j] = &CuMagic::m_set_none;
+    }
+    fill<double, double>(CuVariant::Double);
+    fill<long double, double>(CuVariant::LongDouble);
+    fill<float, float>(CuVariant::Float);
+    fill<int, int>(CuVariant::Int);
+    fill<long int, long long int>(CuVariant::LongInt);
+    fill<long long int, long long int>(CuVariant::LongLongInt);
+    fill<unsigned int, unsigned int>(CuVariant::UInt);
+    fill<unsigned long int, unsigned long long int>(CuVariant::LongUInt);
+    fill<unsigned long long int, unsigned long long int>(CuVariant::LongLongUInt);
+    fill<char, int>(CuVariant::Char);
+    fill<unsigned char, unsigned int>(CuVariant::UChar);
+    fill<short, short>(CuVariant::Short);
+    fill<unsigned short, unsigned short>(CuVariant::UShort);
+    fill<bool, bool>(CuVariant::Boolean);
+    // strings
+    fill_conv(CuVariant::String);
+    set[CuVariant::String][CuMagic::TkMatrix] = &CuMagic::m_set_matrix<std::string, std::string>;
+    mx[CuVariant::String][CuVariant::String] = &CuMagic::m_set_matrix<std::string, std::string>;
+    mx_type<double>(CuVariant::Double);
+    mx_type<long double>(CuVariant::LongDouble);
+    mx_type<float>(CuVariant::Float);
+    mx_type<int>(CuVariant::Int);
+    mx_type<long int>(CuVariant::LongInt);
+    mx_type<long long int>(CuVariant::LongLongInt);
+    mx_type<unsigned int>(CuVariant::UInt);
+    mx_type<unsigned long int>(CuVariant::LongUInt);
+    mx_type<unsigned long long int>(CuVariant::LongLongUInt);
+    mx_type<char>(CuVariant::Char);
+    mx_type<unsigned char>(CuVariant::UChar);
+    mx_type<short>(CuVariant::Short);
+    mx_type<unsigned short>(CuVariant::UShort);
+    mx_type<bool>(CuVariant::Boolean);
+    mx_type<std::string>(CuVariant::String);
+    set[CuVariant::String][CuMagic::TkDynScalar] = &CuMagic::m_set_dyn_str;
+    set[CuVariant::String][CuMagic::TkDynVector] = &CuMagic::m_set_dyn_strlist;
+}
+
+// declared properties: the value is converted to the type of the property, whatever the data type
+void CuMagicDispatch::fill_conv(CuVariant::DataType dt) {
+    CuMagicSetter *row = set[dt];
+    row[CuMagic::TkInt] = &CuMagic::m_set_conv<int, CuMagic::Scalar>;
+    row[CuMagic::TkLongLong] = &CuMagic::m_set_conv<long long int, CuMagic::Scalar>;
+    row[CuMagic::TkUInt] = &CuMagic::m_set_conv<unsigned int, CuMagic::Scalar>;
+    row[CuMagic::TkULongLong] = &CuMagic::m_set_conv<unsigned long long, CuMagic::Scalar>;
+    row[CuMagic::TkDouble] = &CuMagic::m_set_conv<double, CuMagic::Scalar>;
+    row[CuMagic::TkBool] = &CuMagic::m_set_conv<bool, CuMagic::Scalar>;
+    row[CuMagic::TkString] = &CuMagic::m_set_str;
+    row[CuMagic::TkStringList] = &CuMagic::m_set_strlist;
+    row[CuMagic::TkVectorDouble] = &CuMagic::m_set_conv<double, CuMagic::Vector>;
+    row[CuMagic::TkListDouble] = &CuMagic::m_set_conv<double, CuMagic::List>;
+    row[CuMagic::TkVectorInt] = &CuMagic::m_set_conv<int, CuMagic::Vector>;
+    row[CuMagic::TkListInt] = &CuMagic::m_set_conv<int, CuMagic::List>;
+}
+
+// T: the C++ type of the data. DynT: the type used for dynamic properties
+template <typename T, typename DynT> void CuMagicDispatch::fill(CuVariant::DataType dt) {
+    fill_conv(dt);
+    split[dt] = &CuMagic::m_v_split<T>;
+    decim[dt] = &CuMagic::m_decimate<T>;
+    set[dt][CuMagic::TkMatrix] = &CuMagic::m_set_matrix<T, T>;
+    fill_mx<T>(dt);
+    set[dt][CuMagic::TkImage] = &CuMagic::m_set_image<T>;
+    set[dt][CuMagic::TkPixmap] = &CuMagic::m_set_image<T>;
+    set[dt][CuMagic::TkLabel] = &CuMagic::m_set_image<T>;
+    set[dt][CuMagic::TkDynScalar] = &CuMagic::m_set_dyn_scalar<DynT>;
+    set[dt][CuMagic::TkDynVector] = &CuMagic::m_set_dyn_vector<T, DynT>;
+}
+
+// numeric matrix data converts to a CuMatrix property of any numeric type
+template <typename S> void CuMagicDispatch::fill_mx(CuVariant::DataType sdt) {
+    mx[sdt][CuVariant::Double] = &CuMagic::m_set_matrix<S, double>;
+    mx[sdt][CuVariant::LongDouble] = &CuMagic::m_set_matrix<S, long double>;
+    mx[sdt][CuVariant::Float] = &CuMagic::m_set_matrix<S, float>;
+    mx[sdt][CuVariant::Int] = &CuMagic::m_set_matrix<S, int>;
+    mx[sdt][CuVariant::LongInt] = &CuMagic::m_set_matrix<S, long int>;
+    mx[sdt][CuVariant::LongLongInt] = &CuMagic::m_set_matrix<S, long long int>;
+    mx[sdt][CuVariant::UInt] = &CuMagic::m_set_matrix<S, unsigned int>;
+    mx[sdt][CuVariant::LongUInt] = &CuMagic::m_set_matrix<S, unsigned long int>;
+    mx[sdt][CuVariant::LongLongUInt] = &CuMagic::m_set_matrix<S, unsigned long long int>;
+    mx[sdt][CuVariant::Char] = &CuMagic::m_set_matrix<S, char>;
+    mx[sdt][CuVariant::UChar] = &CuMagic::m_set_matrix<S, unsigned char>;
+    mx[sdt][CuVariant::Short] = &CuMagic::m_set_matrix<S, short>;
+    mx[sdt][CuVariant::UShort] = &CuMagic::m_set_matrix<S, unsigned short>;
+    mx[sdt][CuVariant::Boolean] = &CuMagic::m_set_matrix<S, bool>;
+}
+
+template <typename D> void CuMagicDispatch::mx_type(CuVariant::DataType dt) {
+    mx_types.insert(qMetaTypeId<CuMatrix<D> >(), dt);
+}
+
+const CuMagicDispatch &CuMagic::m_dispatch() {
+    static const CuMagicDispatch dispatch;
+    return dispatch;
+}
+
+/*
+ * the strings selected by each mapped object, converted to QString only once per index and only if the
+ * string changed since the last update: the conversions are cached in d->str_cache, the source strings
+ * they come from in d->str_src. The copy made by toStringVector is the only copy of the whole vector
+ */
+bool CuMagic::m_v_str_split(const CuVariant &in, const QMap<QString, opropinfo> &opropis, QMap<QString, QStringList> &out) {
     bool ok = true;
     out.clear();
-    std::vector<std::string> dv;
-    dv = in.toStringVector(&ok);
-    foreach(const opropinfo& opropi, opropis) {
-        std::vector <std::string> subv;
-        foreach(size_t i, opropi.idxs)
-            if(dv.size() > i)
-                subv.push_back(dv[i]);
-        out[opropi.obj->objectName()] = CuVariant(subv);
+    std::vector<std::string> dv = in.toStringVector(&ok);
+    if(d->str_cache.size() < static_cast<int>(dv.size()))
+        d->str_cache.resize(static_cast<int>(dv.size()));
+    std::vector<bool> fresh(dv.size(), false); // converted (or found unchanged) in this update
+    for(QMap<QString, opropinfo>::const_iterator it = opropis.constBegin(); it != opropis.constEnd(); ++it) {
+        QStringList &sl = out[it.key()];
+        sl.reserve(it.value().idxs.size());
+        foreach(int i, it.value().idxs) {
+            if(i < 0 || static_cast<size_t>(i) >= dv.size())
+                continue;
+            if(!fresh[i] && (static_cast<size_t>(i) >= d->str_src.size() || d->str_src[i] != dv[i]))
+                d->str_cache[i] = QString::fromStdString(dv[i]);
+            fresh[i] = true;
+            sl << d->str_cache[i]; // implicitly shared
+        }
     }
+    d->str_src.swap(dv);
+    return ok;
+}
+
+/*
+ * set the strings sl on the property prop of t. String and string list targets take the QStrings as they are,
+ * other targets (e.g. numbers) get them through the dispatch table
+ */
+bool CuMagic::m_strlist_set(QObject *t, const QStringList &sl, const QString &prop) {
+    static const CuVariant strv = CuVariant(std::vector<std::string>()); // type and format, to bind
+    CuMagicBinding &b = d->bindings[qMakePair(static_cast<const QObject *>(t), prop)];
+    if(!b.set || b.dt != strv.getType() || b.fmt != strv.getFormat())
+        m_bind(t, strv, prop, b);
+    bool ok = true;
+    if(b.tk == TkStringList || b.tk == TkDynVector)
+        ok = t->setProperty(b.prop.data(), sl) || b.pi < 0; // false for dynamic props
+    else if(b.tk == TkString || b.tk == TkDynScalar)
+        ok = t->setProperty(b.prop.data(), sl.isEmpty() ? QString() : sl.first()) || b.pi < 0;
+    else {
+        std::vector<std::string> sv;
+        sv.reserve(sl.size());
+        foreach(const QString& s, sl)
+            sv.push_back(s.toStdString());
+        return m_prop_set(t, CuVariant(sv), prop);
+    }
+    if(!ok)
+        perr("CuMagic.m_strlist_set: failed to set %d strings on property \"%s\" on %s", sl.size(), b.prop.data(), qstoc(t->objectName()));
+    else if(!d->display_unit.isEmpty())
+        m_unit_set(t, b);
     return ok;
 }
 
@@ -647,25 +1599,10 @@ QString CuMagic::m_get_idxs(const QString &src) const {
     // \[([\d,\-]+)\]
     QRegularExpression re("\\[([\\d,\\-]+)\\]");
     QRegularExpressionMatch m = re.match(src);
-    QRegularExpression re2("(\\d+)\\s*\\-\\s*(\\d+)");
     bool ok = true;
     d->v_idxs.clear();
-    if(m.capturedTexts().size() > 1) {
-        QString s = m.capturedTexts().at(1);
-        foreach(const QString &t, s.split(',') ) {
-            if(!t.contains('-') && t.toInt(&ok) >= 0 && ok)
-                d->v_idxs << t.trimmed().toInt(&ok);
-            else if(t.contains(re2) && ok) {
-                QRegularExpressionMatch m2 = re2.match(t);
-                const QStringList& ct = m2.capturedTexts();
-                int to = -1, from = ct[1].toInt(&ok);
-                if(ok) to = ct[2].toInt(&ok);
-                for( int q = from; ok && q <= to; q++)
-                    d->v_idxs << q;
-            }
-            if(!ok ) break;
-        }
-    }
+    if(m.capturedTexts().size() > 1)
+        ok = m_ranges(m.capturedTexts().at(1), d->v_idxs);
     if(!ok) {
         d->v_idxs.clear();
         perr("CuMagic.m_get_idxs: error in source syntax \"%s\": correct form: a/b/c/d[1,2,3,7-12,20]", qstoc(src));
@@ -674,6 +1611,126 @@ QString CuMagic::m_get_idxs(const QString &src) const {
     return s.remove(re);
 }
 
+// a/b/c/status[bit:0-31], a/b/c/status[bit:0,3,8-11]
+QString CuMagic::m_get_bits(const QString &src) const {
+    QRegularExpression re("\\[\\s*bit\\s*:\\s*([\\d,\\-\\s]+)\\]");
+    QRegularExpressionMatch m = re.match(src);
+    d->bits.clear();
+    d->bits_valid = false;
+    if(m.hasMatch()) {
+        bool ok = m_ranges(m.captured(1), d->bits);
+        for(int i = 0; ok && i < d->bits.size(); i++)
+            ok = d->bits[i] < 64;
+        if(!ok) {
+            d->bits.clear();
+            perr("CuMagic.m_get_bits: error in source syntax \"%s\": correct form: a/b/c/d[bit:0-31], bits 0 to 63", qstoc(src));
+        }
+    }
+    QString s(src);
+    return s.remove(re);
+}
+
+/*
+ * extract the bits of the integer word v and write them on the targets. Each mapped object gets its bits
+ * (a bool for a single bit). Objects whose bits did not flip since the last update are not written
+ */
+void CuMagic::m_set_bits(const CuVariant &v, std::string msg, bool err) {
+    const CuVariant::DataType dt = v.getType();
+    long long x = 0;
+    if(!err) {
+        const bool integral = CuMagicRaw::elem_size(dt) > 0 && dt != CuVariant::Float && dt != CuVariant::Double
+                && dt != CuVariant::LongDouble;
+        std::vector<long long> vx;
+        err = !integral || (v.getFormat() == CuVariant::Scalar ? !v.to<long long>(x) : !(v.toVector<long long>(vx) && vx.size() > 0));
+        if(!err && v.getFormat() != CuVariant::Scalar)
+            x = vx[0];
+        else if(err)
+            msg = "CuMagic.m_set_bits: bit selector on non integer type \"" + v.dataTypeStr(dt) + "\"";
+    }
+    const quint64 w = static_cast<quint64>(x), flipped = d->bits_valid ? w ^ d->bits_last : ~0ULL;
+    QList<opropinfo> ois = d->omap.values();
+    if(ois.isEmpty()) {
+        opropinfo t(d->target, d->t_prop, 0);
+        t.idxs = d->bits;
+        ois << t;
+    }
+    foreach(const opropinfo& oi, ois) {
+        quint64 mask = 0, field = 0;
+        std::string m(msg);
+        bool e = err;
+        for(int i = 0; i < oi.idxs.size() && !e; i++) {
+            // mapped indexes select among the bits in the source, as they select elements in a vector
+            const int j = oi.idxs[i], b = d->omap.isEmpty() ? j : (j >= 0 && j < d->bits.size() ? d->bits[j] : -1);
+            e = b < 0 || b > 63;
+            if(e)
+                m = "CuMagic.m_set_bits: index " + std::to_string(j) + " out of the bit selector " + m_ranges_to_string(d->bits).toStdString();
+            else {
+                mask |= 1ULL << b;
+                if(i < 64) field |= ((w >> b) & 1ULL) << i;
+            }
+        }
+        if(!e && (flipped & mask))
+            e = oi.idxs.size() == 1 ? !m_prop_set(oi.obj, CuVariant(field != 0), oi.prop)
+                                    : !m_prop_set(oi.obj, CuVariant(static_cast<unsigned long long>(field)), oi.prop);
+        m_err_msg_set(oi.obj, oi.idxs, oi.prop, m, e);
+    }
+    d->bits_last = w;
+    d->bits_valid = !err;
+}
+
+// a/b/c/image[100:164, 200:264], a/b/c/image[5, :], a/b/c/image[:, 10:]
+QString CuMagic::m_get_roi(const QString &src) const {
+    QRegularExpression re("\\[\\s*(\\d*)\\s*(:?)\\s*(\\d*)\\s*,\\s*(\\d*)\\s*(:?)\\s*(\\d*)\\s*\\]");
+    QRegularExpressionMatch m = re.match(src);
+    // at least one colon: [1,2] is a list of indexes (see m_get_idxs)
+    d->roi.on = m.hasMatch() && !(m.captured(2).isEmpty() && m.captured(5).isEmpty());
+    if(!d->roi.on)
+        return src;
+    else {
+        int *lims[2][2] = { { &d->roi.r0, &d->roi.r1 }, { &d->roi.c0, &d->roi.c1 } };
+        for(int i = 0; i < 2 && d->roi.on; i++) {
+            const QString& from = m.captured(1 + 3 * i), &to = m.captured(3 + 3 * i);
+            const bool range = !m.captured(2 + 3 * i).isEmpty();
+            *lims[i][0] = from.isEmpty() ? 0 : from.toInt();
+            *lims[i][1] = range ? (to.isEmpty() ? -1 : to.toInt()) : *lims[i][0] + 1; // -1: up to the end
+            // a single index needs no colon, a range needs one
+            d->roi.on = (range || (!from.isEmpty() && to.isEmpty())) && (*lims[i][1] < 0 || *lims[i][1] > *lims[i][0]);
+        }
+        if(!d->roi.on)
+            perr("CuMagic.m_get_roi: error in source syntax \"%s\": correct form: a/b/c/d[r0:r1, c0:c1]", qstoc(src));
+    }
+    QString s(src);
+    return s.remove(re);
+}
+
+// clip the region of interest to a matrix nr x nc. Whole matrix if no region of interest is set
+bool CuMagic::m_roi(size_t nr, size_t nc, size_t &r0, size_t &r1, size_t &c0, size_t &c1) const {
+    r0 = c0 = 0;
+    r1 = nr;
+    c1 = nc;
+    if(d->roi.on) {
+        r0 = std::min(static_cast<size_t>(d->roi.r0), nr);
+        c0 = std::min(static_cast<size_t>(d->roi.c0), nc);
+        if(d->roi.r1 > -1) r1 = std::min(static_cast<size_t>(d->roi.r1), nr);
+        if(d->roi.c1 > -1) c1 = std::min(static_cast<size_t>(d->roi.c1), nc);
+    }
+    return r1 > r0 && c1 > c0;
+}
+
+QString CuMagic::m_roi_to_string() const {
+    QString s;
+    const int lims[2][2] = { { d->roi.r0, d->roi.r1 }, { d->roi.c0, d->roi.c1 } };
+    for(int i = 0; i < 2; i++) {
+        if(i > 0) s += ",";
+        if(lims[i][1] == lims[i][0] + 1)
+            s += QString::number(lims[i][0]);
+        else
+            s += (lims[i][0] > 0 ? QString::number(lims[i][0]) : QString()) + ":" +
+                    (lims[i][1] > -1 ? QString::number(lims[i][1]) : QString());
+    }
+    return s;
+}
+
 QVariant CuMagic::m_str_convert(const CuVariant &v, CuMagic::TargetDataType tdt) {
     int idx;
     QVariant qva;
@@ -694,52 +1751,126 @@ QVariant CuMagic::m_str_convert(const CuVariant &v, CuMagic::TargetDataType tdt)
         }
         tdt == List ? qva = QVariant::fromValue(out) : qva = QVariant::fromValue(out.toVector());
     }
-    qDebug() << __PRETTY_FUNCTION__ << tdt <<  qva;
     return qva;
 }
 
 void CuMagic::m_configure(const CuData &da) {
+    double *lims[4] = { &d->thr_cfg.min_w, &d->thr_cfg.max_w, &d->thr_cfg.min_a, &d->thr_cfg.max_a };
+    const char *lim_keys[4] = { "min_warning", "max_warning", "min_alarm", "max_alarm" };
+    for(int i = 0; i < 4; i++) // not specified or not a number: NaN
+        if(da.containsKey(lim_keys[i]) && !da[lim_keys[i]].to<double>(*lims[i]))
+            *lims[i] = NAN;
+    double m = NAN, M = NAN;
+    const bool range = da.containsKey(CuDType::Min) && da.containsKey(CuDType::Max)  // da.containsKey("min"), da.containsKey("max")
+            && da[CuDType::Min].to<double>(m) && da[CuDType::Max].to<double>(M) && m != M;  // da["min"], da["max"]
+    d->mu.lock(); // format() and display_unit() may be called from another thread
+    if(da.containsKey(CuDType::NumberFormat)) {  // da.containsKey("format")
+        d->format = QuString(da, "format");
+    }
+    if(da.containsKey("display_unit"))
+        d->display_unit = QuString(da, "display_unit");
+    d->mu.unlock();
     QList<QObject *>objs;
-    if(d->omap.isEmpty() ) objs << parent();
+    if(d->omap.isEmpty() ) objs << d->target;
     else {
         foreach(const opropinfo& oi, d->omap.values())
             objs << oi.obj;
     }
     foreach(QObject *t, objs) {
-        if(da.containsKey(CuDType::Min) && da.containsKey(CuDType::Max)) {  // da.containsKey("min"), da.containsKey("max")
-            double m = -1.0, M = -1.0;
-            da[CuDType::Min].to<double>(m);  // da["min"]
-            da[CuDType::Max].to<double>(M);  // da["max"]
-            if(m != M) {
-                foreach(const QString& p, QStringList() << "minimum" << "min") {
-                    if(t->metaObject()->indexOfProperty(qstoc(p)) > -1) {
-                        t->setProperty(p.toStdString().c_str(), m);
-                    }
-                }
-                foreach(const QString& p, QStringList() << "maximum" << "max") {
-                    if(t->metaObject()->indexOfProperty(qstoc(p)) > -1) {
-                        t->setProperty(qstoc(p), M);
-                    }
-                }
-            }
+        CuMagicCfg &c = d->cfg[t];
+        const bool new_range = range && (m != c.min || M != c.max);
+        const bool new_fmt = !d->format.isEmpty() && d->format != c.format && t->metaObject()->indexOfProperty("format") > -1;
+        if(!new_range && !new_fmt)
+            continue;
+        // one transaction per target: no signals and no repaints until all is set
+        QWidget *w = d->headless ? nullptr : qobject_cast<QWidget *>(t);
+        const bool upd = w && w->updatesEnabled();
+        const QMetaProperty vp = t->metaObject()->userProperty(); // e.g. value of sliders and spin boxes
+        const QVariant v0 = new_range && vp.isValid() && vp.hasNotifySignal() ? vp.read(t) : QVariant();
+        if(upd)
+            w->setUpdatesEnabled(false);
+        {
+            QSignalBlocker sb(t);
+            if(new_range)
+                m_set_range(t, m, M);
+            if(new_fmt)
+                t->setProperty("format", d->format.toStdString().c_str());
         }
-        if(da.containsKey(CuDType::NumberFormat)) {  // da.containsKey("format")
-            d->format = QuString(da, "format");
+        if(upd)
+            w->setUpdatesEnabled(true); // one repaint
+        if(v0.isValid())
+            m_notify_clamped(t, vp, v0);
+        if(new_range) {
+            c.min = m;
+            c.max = M;
         }
-        if(da.containsKey("display_unit"))
-            d->display_unit = QuString(da, "display_unit");
-        if(!d->format.isEmpty() && t->metaObject()->indexOfProperty("format") > -1)
-            t->setProperty("format", d->format.toStdString().c_str());
+        if(new_fmt)
+            c.format = d->format;
     }
 }
 
-void CuMagic::m_err_msg_set(QObject *o, const QList<int> &idxs, const QString &prop, const QString &msg, bool err) {
-    QWidget *w = qobject_cast<QWidget *>(o);
+/*
+ * the value of t may have been clamped to the new range while its signals were blocked:
+ * emit the notify signal of the property p if the value is not v0 any more
+ */
+void CuMagic::m_notify_clamped(QObject *t, const QMetaProperty &p, const QVariant &v0) {
+    const QVariant v = p.read(t);
+    const QMetaMethod sig = p.notifySignal();
+    if(v == v0)
+        return;
+    if(sig.parameterCount() == 0)
+        sig.invoke(t, Qt::DirectConnection);
+    else if(sig.parameterCount() == 1 && sig.parameterType(0) == v.userType())
+        sig.invoke(t, Qt::DirectConnection, QGenericArgument(v.typeName(), v.constData()));
+}
+
+/*
+ * set the range [m, M] on t with a setRange(double, double) or setRange(int, int) invokable, if available.
+ * Otherwise set the minimum/min and maximum/max properties, the maximum first if m is above the current
+ * maximum, so that the minimum never exceeds the maximum in between
+ */
+void CuMagic::m_set_range(QObject *t, double m, double M) {
+    const QMetaObject *mo = t->metaObject();
+    int mi = mo->indexOfMethod("setRange(double,double)");
+    if(mi > -1 && mo->method(mi).invoke(t, Qt::DirectConnection, Q_ARG(double, m), Q_ARG(double, M)))
+        return;
+    mi = mo->indexOfMethod("setRange(int,int)");
+    if(mi > -1 && mo->method(mi).invoke(t, Qt::DirectConnection, Q_ARG(int, qRound(m)), Q_ARG(int, qRound(M))))
+        return;
+    const char *mins[2] = { "minimum", "min" }, *maxs[2] = { "maximum", "max" };
+    bool max_first = false;
+    for(int i = 0; i < 2; i++)
+        if(mo->indexOfProperty(maxs[i]) > -1)
+            max_first |= m > t->property(maxs[i]).toDouble();
+    for(int k = 0; k < 2; k++) {
+        const bool set_max = (k == 0) == max_first;
+        for(int i = 0; i < 2; i++) {
+            const char *p = set_max ? maxs[i] : mins[i];
+            if(mo->indexOfProperty(p) > -1)
+                t->setProperty(p, set_max ? M : m);
+        }
+    }
+}
+
+/*
+ * error state, tooltip and error message of o are updated on each error/recovery transition only.
+ * While the state does not change, a different message is shown at most once per second
+ */
+void CuMagic::m_err_msg_set(QObject *o, const QList<int> &idxs, const QString &prop, const std::string &msg, bool err) {
+    CuMagicErrState &es = d->err_states[o];
+    if(es.t.isValid() && es.err == err && (es.msg == msg || es.t.elapsed() < 1000))
+        return;
+    es.err = err;
+    es.msg = msg;
+    es.t.start();
+    QWidget *w = d->headless ? nullptr : qobject_cast<QWidget *>(o);
     if(w && (w->metaObject()->indexOfProperty("disable_on_error") > -1 || w->property("disable_on_error").toBool()) ) {
         w->setDisabled(err);
     }
     int i = 0;
-    QString m(msg + " [");
+    QString m(thread() == d->ctx_thread ? source() : m_src()); // the reader belongs to the thread of the context
+    if(msg.length() > 0) m += "\n" + QString::fromStdString(msg);
+    m += " [";
     for(i = 0; i < idxs.size() - 1; i++) m += QString("%1, ").arg(idxs[i]);
     if(i < idxs.size()) m += QString("%1").arg(idxs[i]);
     m += "]";
@@ -748,23 +1879,159 @@ void CuMagic::m_err_msg_set(QObject *o, const QList<int> &idxs, const QString &p
     else if(err) perr("CuMagic: error: %s", qstoc(m));
 }
 
-QString CuMagic::m_idxs_to_string() const {
-    QString s;
-    int i = 0, j = 0;
-    while(i < d->v_idxs.size()) {
-        j = i;
-        while(j + 1 < d->v_idxs.size() && d->v_idxs[j+1] - d->v_idxs[j] == 1)
-            j++;
-        if(j > i && j <= d->v_idxs.size()) {
-            s += QString("%1-%2").arg(d->v_idxs[i]).arg(d->v_idxs[j]);
+// element i of the numeric value v as double, without converting the whole vector
+template <typename T> static double m_at(const void *p, size_t i) {
+    return static_cast<double>(static_cast<const T *>(p)[i]);
+}
+
+static bool m_elem(const CuVariant &v, size_t i, double &x) {
+    if(v.getFormat() == CuVariant::Scalar)
+        return i == 0 && v.to<double>(x);
+    size_t nr = 0, nc = 0;
+    const void *p = CuMagicRaw::data(v, &nr, &nc);
+    if(!p || i >= nr * nc)
+        return false;
+    switch(v.getType()) {
+    case CuVariant::Short: x = m_at<short>(p, i); break;
+    case CuVariant::UShort: x = m_at<unsigned short>(p, i); break;
+    case CuVariant::Int: x = m_at<int>(p, i); break;
+    case CuVariant::UInt: x = m_at<unsigned int>(p, i); break;
+    case CuVariant::LongInt: x = m_at<long int>(p, i); break;
+    case CuVariant::LongUInt: x = m_at<unsigned long int>(p, i); break;
+    case CuVariant::LongLongInt: x = m_at<long long int>(p, i); break;
+    case CuVariant::LongLongUInt: x = m_at<unsigned long long int>(p, i); break;
+    case CuVariant::Float: x = m_at<float>(p, i); break;
+    case CuVariant::Double: x = m_at<double>(p, i); break;
+    case CuVariant::LongDouble: x = m_at<long double>(p, i); break;
+    case CuVariant::Char: x = m_at<char>(p, i); break;
+    case CuVariant::UChar: x = m_at<unsigned char>(p, i); break;
+    default: return false;
+    }
+    return true;
+}
+
+// state of x with the limits moved inwards by h. NaN limits never match
+static int m_alarm_level(const CuMagicThresholds &t, double x, double h) {
+    if(x <= t.min_a + h || x >= t.max_a - h)
+        return CuMagicI::StateAlarm;
+    if(x <= t.min_w + h || x >= t.max_w - h)
+        return CuMagicI::StateWarning;
+    return CuMagicI::StateValid;
+}
+
+/*
+ * state machine of each target: the state rises as soon as a limit is reached and falls only when the
+ * value is within the limits of the lower state by the hysteresis. Targets are restyled on transitions only
+ */
+void CuMagic::m_alarm_eval(const CuVariant &v) {
+    const CuMagicThresholds &t = d->thr.on() ? d->thr : d->thr_cfg;
+    QList<QPair<QObject *, int> > tgts; // object, element of v
+    if(d->omap.isEmpty())
+        tgts << qMakePair(d->target.data(), d->v_idxs.isEmpty() ? 0 : d->v_idxs[0]);
+    else
+        foreach(const opropinfo& oi, d->omap.values())
+            if(!oi.idxs.isEmpty())
+                tgts << qMakePair(oi.obj, oi.idxs[0]);
+    for(int i = 0; i < tgts.size(); i++) {
+        double x;
+        if(!m_elem(v, tgts[i].second, x) || std::isnan(x))
+            continue;
+        const int cur = d->alarm_states.value(tgts[i].first, StateValid);
+        int s = m_alarm_level(t, x, 0.0);
+        if(s < cur)
+            s = std::min(cur, m_alarm_level(t, x, t.hyst));
+        if(s != cur)
+            m_alarm_set(tgts[i].first, s);
+    }
+}
+
+void CuMagic::m_alarm_set(QObject *o, int state) {
+    d->alarm_states[o] = state;
+    o->setProperty("cumagic_alarm_state", state);
+    QWidget *w = d->headless ? nullptr : qobject_cast<QWidget *>(o);
+    if(w && !d->alarm_css[state].isEmpty()) {
+        if(!d->alarm_css_orig.contains(w))
+            d->alarm_css_orig.insert(w, w->styleSheet());
+        w->setStyleSheet(d->alarm_css[state]);
+    }
+    else if(w && d->alarm_css_orig.contains(w)) // back to the style sheet of the application
+        w->setStyleSheet(d->alarm_css_orig.take(w));
+    else if(w) { // rules selecting on cumagic_alarm_state
+        w->style()->unpolish(w);
+        w->style()->polish(w);
+    }
+    emit alarmStateChanged(o, state);
+}
+
+// forget a mapped object: o is being destroyed and its address may be reused
+void CuMagic::m_obj_destroyed(QObject *o) {
+    d->err_states.remove(o);
+    d->cfg.remove(o);
+    d->alarm_states.remove(o);
+    d->alarm_css_orig.remove(o);
+    QHash<QPair<const QObject *, QString>, CuMagicBinding>::iterator bi = d->bindings.begin();
+    while(bi != d->bindings.end()) {
+        if(bi.key().first == o) bi = d->bindings.erase(bi);
+        else ++bi;
+    }
+    QMap<QString, opropinfo>::iterator oi = d->omap.begin();
+    while(oi != d->omap.end()) {
+        if(oi.value().obj == o) oi = d->omap.erase(oi);
+        else ++oi;
+    }
+}
+
+/*
+ * exponential backoff: the period doubles on each error, up to d->backoff_max, and returns
+ * to the period in the context options on recovery
+ */
+void CuMagic::m_backoff(bool err) {
+    const int base = m_base_period();
+    if(err)
+        m_set_period(std::min(std::max(d->period, base) * 2, std::max(d->backoff_max, base)));
+    else if(d->backoff_on)
+        m_set_period(base);
+    d->backoff_on = err;
+}
+
+/*
+ * adaptive period: doubles after d->adapt_n unchanged values in a row, up to d->adapt_max,
+ * and returns to the period in the context options as soon as the value changes
+ */
+void CuMagic::m_adapt_period(const CuVariant &v) {
+    const int base = m_base_period();
+    if(v == d->adapt_last) {
+        if(++d->adapt_same >= d->adapt_n) {
+            d->adapt_same = 0;
+            m_set_period(std::min(std::max(d->period, base) * 2, std::max(d->adapt_max, base)));
         }
-        else
-            s += QString("%1").arg(d->v_idxs[i]);
-        if(j < d->v_idxs.size() - 1)
-            s += ",";
-        i = j + 1;
     }
-    return s;
+    else {
+        d->adapt_last = v;
+        d->adapt_same = 0;
+        if(d->period > base)
+            m_set_period(base);
+    }
+}
+
+// the period in the context options, if set, otherwise the engines' default, 1000ms
+int CuMagic::m_base_period() const {
+    int p = 1000;
+    if(d->context->options().containsKey("period"))
+        d->context->options()["period"].to<int>(p);
+    return p;
+}
+
+// ask the reader to change the polling period, if different from the last requested
+void CuMagic::m_set_period(int ms) {
+    if(ms != d->period) {
+        d->period = ms;
+        d->context->sendData(CuData("period", ms));
+    }
+}
+
+QString CuMagic::m_idxs_to_string() const {
+    return m_ranges_to_string(d->v_idxs);
 }
 
 #if QT_VERSION < 0x050000
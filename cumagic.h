@@ -4,7 +4,20 @@
 #include <QObject>
 #include <QMetaType>
 #include <QList>
+#include <QHash>
+#include <QPair>
+#include <QByteArray>
+#include <QImage>
+#include <QRgb>
+#include <QPointer>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <limits>
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
 #include <cumagicplugininterface.h>
+#include <cumagichistogram.h>
 #include <cudata.h>
 #include <cudatalistener.h>
 #include <qustring.h>
@@ -33,7 +46,87 @@ class CumbiaPool;
 class CuControlsReaderFactoryI;
 class CuControlsFactoryPool;
 class CuControlsReaderA;
+class CuMagic;
+class CuMagicBinding;
+class CuMagicScheduler;
+class CuMagicCapture;
+class CuMagicShm;
+class QMetaProperty;
+class QTimer;
+class QThread;
+class CuContext;
+struct CuMagicDispatch;
 
+typedef bool (CuMagic::*CuMagicSetter)(QObject *, const CuVariant&, CuMagicBinding&);
+typedef bool (CuMagic::*CuMagicDecimator)(const CuVariant&, size_t, std::vector<double>&, std::vector<double>&);
+typedef bool (CuMagic::*CuMagicSplitter)(const CuVariant&, const QMap<QString, opropinfo>&, QMap<QString, CuVariant>&);
+
+/*
+ * A property of an object bound to the type and format of the data. The setter is resolved
+ * once from the dispatch table and is used until type or format of the data change
+ */
+class CuMagicBinding {
+public:
+    CuMagicBinding() : pi(-1), tk(0), dt(CuVariant::TypeInvalid), fmt(CuVariant::FormatInvalid), set(nullptr), range_mi(-1) {}
+    QByteArray prop; // property name
+    int pi; // property index, -1 for dynamic properties
+    int tk; // CuMagic::TargetKind
+    CuVariant::DataType dt;
+    CuVariant::DataFormat fmt;
+    CuMagicSetter set;
+    QImage image; // reused by image targets
+    int range_mi; // index of the target updateRange(int, QVector<T>) method, -1 if missing
+    QVariant last; // QVector<T> last applied, if range_mi > -1
+};
+
+// region of interest of matrix data, rows [r0, r1) and columns [c0, c1). -1: up to the end
+class CuMagicRoi {
+public:
+    bool on;
+    int r0, r1, c0, c1;
+};
+
+// warning and alarm limits, NaN if not set. See CuMagic::setThresholds
+class CuMagicThresholds {
+public:
+    CuMagicThresholds() : min_w(NAN), max_w(NAN), min_a(NAN), max_a(NAN), hyst(0.0) {}
+    bool on() const { return !std::isnan(min_w) || !std::isnan(max_w) || !std::isnan(min_a) || !std::isnan(max_a); }
+    double min_w, max_w, min_a, max_a, hyst;
+};
+
+// configuration last applied on an object, see CuMagic::m_configure
+class CuMagicCfg {
+public:
+    CuMagicCfg() : min(NAN), max(NAN) {}
+    double min, max;
+    QString format;
+};
+
+// last error state notified on an object, see CuMagic::m_err_msg_set
+class CuMagicErrState {
+public:
+    bool err;
+    std::string msg;
+    QElapsedTimer t;
+};
+
+/*
+ * listener of the reader of a headless magic. It lives in the thread of the context, where the magic is
+ * created, and forwards data to the magic until detached by ~CuMagic, in the thread of the target. It owns
+ * the context once detached and deletes it in the thread of the context
+ */
+class CuMagicRelay : public QObject, public CuDataListener {
+public:
+    CuMagicRelay(CuMagic *m);
+    ~CuMagicRelay();
+    void onUpdate(const CuData &da);
+    void detach(CuContext *ctx);
+
+private:
+    QMutex m_mu;
+    CuMagic *m_magic;
+    CuContext *m_ctx;
+};
 
 class CuMagicPrivate
 {
@@ -41,12 +134,56 @@ public:
     CuContext *context;
     CuVariant on_error_value;
     QList<int> v_idxs;
+    QList<int> bits; // [bit:...] selector
+    quint64 bits_last; // last word, if bits_valid
+    bool bits_valid;
     QMap<QString, opropinfo> omap;
+    std::vector<std::string> str_src; // source strings of str_cache, see CuMagic::m_v_str_split
+    QVector<QString> str_cache;
     QMap<QString, QString> propmap;
     QString t_prop;
     QString format, display_unit;
     QString src; // bare src passed in setSource
+    QHash<QPair<const QObject *, QString>, CuMagicBinding> bindings;
     bool onetime;
+    bool xform; // scale, offset and clamp, see CuMagic::setTransform
+    double xf_scale, xf_offset, xf_min, xf_max;
+    double img_min, img_max; // see CuMagic::setImageRange
+    QVector<QRgb> lut; // colormap, see CuMagic::setColormap
+    CuMagicRoi roi;
+    int bin_rows, bin_cols, bin_mode; // see CuMagic::setBinning
+    int decim; // see CuMagic::setDecimation
+    double range_thr; // see CuMagic::setRangeUpdateThreshold
+    bool dyn_vlist; // see CuMagic::setDynamicVariantList
+    QPointer<CuMagicScheduler> sched;
+    int prio; // cached priority, -1: to compute, see CuMagic::priority
+    QPointer<CuMagicCapture> capture;
+    QString rq_src; // bare src passed in setSource, even if the reader could not be created
+    CuMagicHistogram lat[2]; // see CuMagicI::LatencyStage
+    CuMagicLatency *latency; // plugin wide, by source
+    CuMagicLatency::Entry *lat_e; // entry of rq_src in latency, see setSource
+    CuMagicShm *shm; // shared memory export, plugin wide
+    QHash<const QObject *, CuMagicErrState> err_states;
+    QHash<const QObject *, CuMagicCfg> cfg;
+    CuMagicThresholds thr, thr_cfg; // set with setThresholds, from the configuration
+    QHash<const QObject *, int> alarm_states; // CuMagicI::AlarmState
+    QString alarm_css[3];
+    QHash<const QObject *, QString> alarm_css_orig; // widget style sheet before the first alarm_css
+    int backoff_max; // see CuMagic::setErrorBackoff
+    int period; // last period requested to the reader, 0 if never
+    bool backoff_on; // last data was an error, see m_backoff
+    int adapt_max, adapt_n, adapt_same; // see CuMagic::setAdaptivePeriod
+    CuVariant adapt_last;
+    bool lazy; // see CuMagic::setLazyConnect
+    int hide_ms;
+    QTimer *hide_timer;
+    QString lazy_src; // source to connect when a target is shown
+    QPointer<QObject> target;
+    bool headless; // see CuMagicPlugin::new_magic_headless
+    QThread *ctx_thread; // thread of the context, where this is created
+    CuMagicRelay *relay; // headless only
+    QMutex mu; // rq_src, lat, lat_e, format, display_unit and queue, shared with the thread of a headless target
+    QList<CuData> queue; // data for m_apply_queued
 };
 
 
@@ -56,10 +193,39 @@ public:
 
     enum TargetDataType { Scalar, Vector, List };
 
+    // kind of the target property, second dimension of the dispatch table
+    enum TargetKind { TkInvalid = 0, TkInt, TkLongLong, TkUInt, TkULongLong, TkDouble, TkBool,
+                      TkString, TkStringList, TkVectorDouble, TkListDouble, TkVectorInt, TkListInt,
+                      TkMatrix, TkDynScalar, TkDynVector, TkImage, TkPixmap, TkLabel, TkEndKinds };
+
     CuMagic(QObject* target, CumbiaPool *cu_pool, const CuControlsFactoryPool &fpoo,
-            const QString& source = QString(), const QString &property = QString());
+            const QString& source = QString(), const QString &property = QString(), bool headless = false);
     ~CuMagic();
     void setErrorValue(const CuVariant& v);
+    void setTransform(double scale, double offset,
+                      double clampMin = -std::numeric_limits<double>::infinity(),
+                      double clampMax = std::numeric_limits<double>::infinity());
+    void clearTransform();
+    void setImageRange(double min, double max);
+    void setColormap(const QVector<QRgb>& lut);
+    void setBinning(int rows, int cols, BinMode mode = BinMean);
+    void setDecimation(int points);
+    void setRangeUpdateThreshold(double fraction);
+    void setDynamicVariantList(bool vlist);
+    void setErrorBackoff(int maxPeriodMs);
+    void setLazyConnect(bool lazy, int disconnectAfterMs = 0);
+    void setAdaptivePeriod(int maxPeriodMs, int unchanged = 5);
+    void setThresholds(double minWarning, double maxWarning, double minAlarm, double maxAlarm, double hysteresis = 0.0);
+    void setAlarmStyleSheet(AlarmState state, const QString& styleSheet);
+    AlarmState alarmState(QObject *target = nullptr) const;
+    void setScheduler(CuMagicScheduler *s);
+    void setCapture(CuMagicCapture *c);
+    void setLatency(CuMagicLatency *l);
+    void setShm(CuMagicShm *shm);
+    double latencyPercentile(LatencyStage stage, double p) const;
+    QVector<quint64> latencyHistogram(LatencyStage stage) const;
+    void resetLatency();
+    int priority() const;
 
     QString &operator [](std::size_t idx);
     const QString& operator[](std::size_t idx) const;
@@ -76,10 +242,17 @@ public:
 public:
     void onUpdate(const CuData &data);
 
+    bool eventFilter(QObject *o, QEvent *e);
+
 private slots:
+    void m_hidden_timeout();
+    void m_obj_destroyed(QObject *o);
+    void m_priority_changed();
+    void m_apply_queued();
 
 signals:
     void newData(const CuData& da);
+    void alarmStateChanged(QObject *target, int state);
 
     // CuMagicI interface
 public:
@@ -95,9 +268,48 @@ public:
 private:
     CuMagicPrivate *d;
 
+    friend struct CuMagicDispatch;
+    friend class CuMagicScheduler;
+    friend class CuMagicCapture;
+
+    void m_apply(const CuData& data);
+    QString m_replay_source() const;
+    void m_connect(const QString& s);
+    bool m_shown() const;
+    QList<QObject *> m_targets() const;
+
     bool m_prop_set(QObject* t, const CuVariant& v, const QString& prop);
-    bool m_v_str_split(const CuVariant& in, const QMap<QString, opropinfo> &opromap, QMap<QString, CuVariant> &out);
+    void m_bind(QObject *t, const CuVariant& v, const QString& prop, CuMagicBinding& b);
+    static TargetKind m_target_kind(const QMetaProperty& mp);
+    static const CuMagicDispatch& m_dispatch();
+    void m_unit_set(QObject *t, const CuMagicBinding& b);
+
+    // setters, see CuMagicDispatch
+    template <typename T, int tdt> bool m_set_conv(QObject *t, const CuVariant& v, CuMagicBinding& b);
+    template <typename T> bool m_set_ranges(QObject *t, const QVector<T>& y, const QVariant& qva, CuMagicBinding& b);
+    template <typename T, int tdt> bool m_set_decimated(QObject *t, const CuVariant& v, CuMagicBinding& b);
+    template <typename T> bool m_decimate(const CuVariant& v, size_t np, std::vector<double>& x, std::vector<double>& y);
+    template <typename S, typename D> bool m_set_matrix(QObject *t, const CuVariant& v, CuMagicBinding& b);
+    template <typename T> bool m_set_image(QObject *t, const CuVariant& v, CuMagicBinding& b);
+    template <typename T> bool m_to_image(QObject *t, const CuVariant& v, QImage& img);
+    template <typename T> void m_img_fill(const T *base, size_t stride, int nr, int nc, QImage& img);
+    void m_bin_factors(QObject *t, size_t nr, size_t nc, size_t& by, size_t& bx) const;
+    template <typename T> bool m_set_dyn_scalar(QObject *t, const CuVariant& v, CuMagicBinding& b);
+    template <typename S, typename D> bool m_set_dyn_vector(QObject *t, const CuVariant& v, CuMagicBinding& b);
+    bool m_set_str(QObject *t, const CuVariant& v, CuMagicBinding& b);
+    bool m_set_strlist(QObject *t, const CuVariant& v, CuMagicBinding& b);
+    bool m_set_dyn_str(QObject *t, const CuVariant& v, CuMagicBinding& b);
+    bool m_set_dyn_strlist(QObject *t, const CuVariant& v, CuMagicBinding& b);
+    bool m_set_none(QObject *t, const CuVariant& v, CuMagicBinding& b);
+
+    bool m_v_str_split(const CuVariant& in, const QMap<QString, opropinfo> &opromap, QMap<QString, QStringList> &out);
+    bool m_strlist_set(QObject *t, const QStringList& sl, const QString& prop);
     QString m_get_idxs(const QString& src) const;
+    QString m_get_roi(const QString& src) const;
+    QString m_get_bits(const QString& src) const;
+    void m_set_bits(const CuVariant& v, std::string msg, bool err);
+    bool m_roi(size_t nr, size_t nc, size_t& r0, size_t& r1, size_t& c0, size_t& c1) const;
+    QString m_roi_to_string() const;
 
     template <typename T> bool m_v_split(const CuVariant& in, const QMap<QString, opropinfo>& opromap, QMap<QString, CuVariant> &out) {
         bool ok = true;
@@ -116,50 +328,112 @@ private:
 
     QVariant m_str_convert(const CuVariant& v, TargetDataType tdt = Scalar);
 
+    // x as T. Rounded and saturated to the range of an integral T, so that the conversion is always defined
+    template <typename T> static T m_cast(double x) {
+        if(!std::is_integral<T>::value)
+            return static_cast<T>(x);
+        const double lo = static_cast<double>(std::numeric_limits<T>::lowest()); // 0 or -2^digits: exact
+        const double hi = std::ldexp(1.0, std::numeric_limits<T>::digits); // max() + 1: exact
+        x = std::floor(x + 0.5);
+        if(x >= hi)
+            return std::numeric_limits<T>::max();
+        return x > lo ? static_cast<T>(x) : std::numeric_limits<T>::lowest(); // NaN as well
+    }
+
+    /*
+     * in place scale, offset and clamp of n values. Branch free loop over contiguous
+     * storage, so that the compiler can vectorize it. No op if no transform is set.
+     */
+    template <typename T> void m_transform(T* p, size_t n) const {
+        if(d->xform)
+            m_transform(p, p, n);
+    }
+    // scale, offset and clamp of n values from src into dst, computed in double and cast once
+    template <typename S, typename T> void m_transform(const S* src, T* dst, size_t n) const {
+        const double s = d->xf_scale, o = d->xf_offset, lo = d->xf_min, hi = d->xf_max;
+        for(size_t i = 0; i < n; i++) {
+            double x = static_cast<double>(src[i]) * s + o;
+            x = x < lo ? lo : x;
+            x = x > hi ? hi : x;
+            dst[i] = m_cast<T>(x);
+        }
+    }
+    void m_transform(bool *, size_t ) const { } // no transform on booleans
+    template <typename T> void m_transform(std::vector<T>& v) const { m_transform(v.data(), v.size()); }
+    void m_transform(std::vector<bool>& ) const { }
+    template <typename T> void m_transform(const std::vector<double>& src, std::vector<T>& dst) const {
+        dst.resize(src.size());
+        m_transform(src.data(), dst.data(), src.size());
+    }
+    void m_transform(const std::vector<double>& , std::vector<bool>& ) const { }
+
+    // keep the elements at the indexes in d->v_idxs, if any
+    template <typename T> void m_pick(std::vector<T>& v) const {
+        if(d->v_idxs.isEmpty())
+            return;
+        std::vector<T> picked;
+        picked.reserve(d->v_idxs.size());
+        foreach(size_t i, d->v_idxs)
+            if(v.size() > i)
+                picked.push_back(v[i]);
+        v.swap(picked);
+    }
+
     template <typename T> QVariant m_convert(const CuVariant& v, TargetDataType tdt = Scalar) {
         size_t idx;
         QVariant qva;
         d->v_idxs.size() > 0 ? idx = d->v_idxs[0] : idx = 0;
         std::vector<T> vi; // convert to vector always
-        bool converted = v.toVector<T>(vi) && vi.size() > idx;
-        if(converted && tdt == Scalar && idx < vi.size()) {
-            qva = QVariant(vi[idx]);
+        bool converted;
+        if(d->xform && std::is_integral<T>::value && !std::is_same<T, bool>::value) {
+            // transform before the conversion to T, so that fractions are scaled and not truncated first
+            std::vector<double> vd;
+            converted = v.toVector<double>(vd) && vd.size() > idx;
+            if(converted) {
+                m_pick(vd);
+                m_transform(vd, vi);
+            }
+        }
+        else {
+            converted = v.toVector<T>(vi) && vi.size() > idx;
+            if(converted) {
+                m_pick(vi);
+                m_transform(vi);
+            }
+        }
+        if(converted && tdt == Scalar && !vi.empty()) {
+            T x = vi[0]; // vi[idx] before m_pick
+            qva = QVariant(x);
         }
-        else if(converted && tdt == Vector) {
-            QVector<T> out;
-            if(d->v_idxs.isEmpty()) // the whole vector
+        else if(converted && (tdt == Vector || tdt == List)) {
+            if(tdt == Vector)
 #if (QT_VERSION >= QT_VERSION_CHECK(5, 14, 0))
-                out = QVector<T>(vi.begin(), vi.end());
+                qva = QVariant::fromValue(QVector<T>(vi.begin(), vi.end()));
 #else
-                out = QVector<T>::fromStdVector(vi);
+                qva = QVariant::fromValue(QVector<T>::fromStdVector(vi));
 #endif
-            else  { // pick desired indexes
-                foreach( size_t i, d->v_idxs)
-                    if(vi.size() > i)
-                        out << vi[i];
-            }
-            qva = QVariant::fromValue(out);
-        }
-        else if(converted && tdt == List) {
-            QList<T> out;
-            if(d->v_idxs.isEmpty()) // the whole vector
+            else
 #if (QT_VERSION >= QT_VERSION_CHECK(5, 14, 0))
-                out = QList<T>(vi.begin(), vi.end());
+                qva = QVariant::fromValue(QList<T>(vi.begin(), vi.end()));
 #else
-                out = QVector<T>::fromStdVector(vi).toList();
+                qva = QVariant::fromValue(QVector<T>::fromStdVector(vi).toList());
 #endif
-            else  { // pick desired indexes
-                foreach( size_t i, d->v_idxs)
-                    if(vi.size() > i)
-                        out << vi[i];
-            }
-            qva = QVariant::fromValue(out);
         }
         return qva;
     } // end template function m_convert
 
     void m_configure(const CuData& da);
-    void m_err_msg_set(QObject* o, const QList<int>&idxs, const QString& prop, const QString& msg, bool err);
+    void m_set_range(QObject *t, double m, double M);
+    void m_notify_clamped(QObject *t, const QMetaProperty& p, const QVariant& v0);
+    int m_priority() const;
+    QString m_src() const;
+    void m_err_msg_set(QObject* o, const QList<int>&idxs, const QString& prop, const std::string& msg, bool err);
+    void m_backoff(bool err);
+    void m_adapt_period(const CuVariant& v);
+    void m_alarm_eval(const CuVariant& v);
+    void m_alarm_set(QObject *o, int state);
+    int m_base_period() const;
+    void m_set_period(int ms);
     QString m_idxs_to_string() const;
 };
 
@@ -181,15 +455,19 @@ private:
  * \li cumbia spectrum data and no indexes specified: the whole vector is set on the property
  * \li cumbia spectrum data with indexes specified: the set of indexes determines which values are taken from the vector and
  *     *set* on the property.
+ * \li cumbia spectrum data on a property not declared by the target: a dynamic property holding a packed QVector<T>
+ *     (a QVariantList with setDynamicVariantList)
  *
  * \subsection list_of_objects CuMagic attached to a list of objects
  *
  * \li cumbia *scalar* data: can only be used in context number 1.
  * \li cumbia *spectrum* data: through index mapping, each element of the data array can be displayed in the specified object
  * \li cumbia *matrix* data: can only be used in context number 1. The plugin registers the CuMatrix as Qt meta type for the supported types.
+ * \li cumbia numeric *matrix* data on a QImage or QPixmap property, or on a QLabel: the matrix is shown as an image
+ *     through a colormap (see setImageRange and setColormap)
  *
- * \note Type in *matrix* data must be consistent with *type* in object properties. In other words a CuMatrix<double> data cannot be set on
- *       an int type property.
+ * \note If the object property is a CuMatrix of another numeric type, the elements of *matrix* data are converted while they are
+ *       copied. For example, CuMatrix<double> data is set on a CuMatrix<int> property as a CuMatrix<int>.
  *
  * Please read CuMagicPluginInterface documentation and the <em>magicdemo</em> example
  * under the examples subfolder of the plugin directory.
@@ -237,9 +515,28 @@ public:
     // CuMagicPluginInterface interface
 public:
     CuMagicI *new_magic(QObject *target, const QString &source = QString(), const QString &property = QString()) const;
+    CuMagicAggI *new_magic_agg(QObject *target, const QStringList &sources = QStringList(), const QString &property = QString()) const;
+    CuMagicI *new_magic_headless(QObject *target, const QString &source = QString(), const QString &property = QString()) const;
+    void setUpdateBudget(int us);
+    int updateBudget() const;
+    void setLazyConnect(bool lazy, int disconnectAfterMs = 0);
+    QStringList latencySources() const;
+    double latencyPercentile(const QString& source, int stage, double p) const;
+    QVector<quint64> latencyHistogram(const QString& source, int stage) const;
+    void resetLatency();
+    void registerSynthEngine();
+    bool startRecording(const QString& path, qint64 maxBytes = 256 << 20);
+    void stopRecording();
+    bool startReplay(const QString& path, double speed = 1.0);
+    void stopReplay();
+    bool startShmExport(const QString& name, int nslots = 256, int slotSize = 16384);
+    void stopShmExport();
     void init(CumbiaPool *cumbia_pool, const CuControlsFactoryPool &fpool);
     const QObject *get_qobject() const;
 
+signals:
+    void replayFinished();
+
 private:
     CuMagicPluginPrivate *d;
 };
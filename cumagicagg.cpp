@@ -0,0 +1,222 @@
+#include "cumagicagg.h"
+#include <cucontext.h>
+#include <cucontrolsreader_abs.h>
+#include <cudatalistener.h>
+#include <cudata.h>
+#include <cumacros.h>
+#include <QTimer>
+#include <QHash>
+#include <QVector>
+#include <QMetaProperty>
+#include <QRegularExpression>
+#include <QSet>
+#include <limits>
+
+// listener of the reader of the source at index idx: updates are matched by reader, not by source name
+class CuMagicAggListener : public CuDataListener {
+public:
+    CuMagicAggListener(CuMagicAgg *a, int i) : agg(a), idx(i) {}
+    void onUpdate(const CuData &data) { agg->m_update(idx, data); }
+
+    CuMagicAgg *agg;
+    int idx;
+};
+
+class CuMagicAggPrivate {
+public:
+    CuContext *context;
+    QStringList srcs; // expanded sources, as given (e.g. with $1), without duplicates
+    QList<CuMagicAggListener *> listeners; // one per reader
+    std::vector<double> buf;
+    std::vector<bool> updated;
+    int n_updated;
+    int n_readers; // readers created: an update from each flushes
+    QString t_prop;
+    QTimer *timer;
+};
+
+/*!
+ * \brief CuMagicAgg::CuMagicAgg aggregate the scalar values from many sources into a vector property
+ * \param target the target object, which becomes the parent of this object
+ * \param cu_pool a pointer to a previously allocated CumbiaPool
+ * \param fpoo a const reference to CuControlsFactoryPool
+ * \param sources list of sources or source patterns. See setSources
+ * \param property the name of the vector property. If empty, *value* is used
+ */
+CuMagicAgg::CuMagicAgg(QObject *target, CumbiaPool *cu_pool, const CuControlsFactoryPool &fpoo,
+                       const QStringList &sources, const QString &property) : QObject(target) {
+    d = new CuMagicAggPrivate;
+    d->context = new CuContext(cu_pool, fpoo);
+    d->n_updated = d->n_readers = 0;
+    d->t_prop = property.isEmpty() ? "value" : property;
+    d->timer = new QTimer(this);
+    d->timer->setSingleShot(true);
+    d->timer->setInterval(1000);
+    connect(d->timer, SIGNAL(timeout()), this, SLOT(flush()));
+    if(!sources.isEmpty())
+        setSources(sources);
+}
+
+CuMagicAgg::~CuMagicAgg() {
+    if(d->context)
+        delete d->context;
+    qDeleteAll(d->listeners);
+    delete d;
+}
+
+/*!
+ * \brief expand a source pattern into the list of sources
+ * \param pattern a source where each *[...]* group lists indexes and ranges, e.g. *$1/bpm[0-3,7]/x*
+ * \return the list of sources, e.g. *$1/bpm0/x, $1/bpm1/x, $1/bpm2/x, $1/bpm3/x, $1/bpm7/x*
+ *
+ * If the first number of a range has leading zeroes, the expanded numbers are zero padded to the
+ * same width: *ch[01-12]* expands into *ch01, ch02, ..., ch12*
+ */
+QStringList CuMagicAgg::expand(const QString &pattern) {
+    QStringList out;
+    QRegularExpression re("\\[([\\d,\\-\\s]+)\\]");
+    QRegularExpression re2("(\\d+)\\s*\\-\\s*(\\d+)");
+    QRegularExpressionMatch m = re.match(pattern);
+    if(!m.hasMatch())
+        return out << pattern;
+    const QString& head = pattern.left(m.capturedStart(0)), &tail = pattern.mid(m.capturedEnd(0));
+    QStringList tails = expand(tail);
+    bool ok = true;
+    foreach(const QString &t, m.captured(1).split(',')) {
+        int from, to, w = 0;
+        QRegularExpressionMatch m2 = re2.match(t);
+        if(m2.hasMatch()) {
+            from = m2.captured(1).toInt(&ok);
+            if(ok) to = m2.captured(2).toInt(&ok);
+            if(m2.captured(1).startsWith('0')) w = m2.captured(1).length();
+        }
+        else {
+            from = to = t.trimmed().toInt(&ok);
+            if(t.trimmed().startsWith('0')) w = t.trimmed().length();
+        }
+        if(!ok) {
+            perr("CuMagicAgg.expand: error in source pattern \"%s\": correct form: a/b[0-63]/c", qstoc(pattern));
+            return QStringList();
+        }
+        for(int i = from; i <= to; i++)
+            foreach(const QString& ta, tails)
+                out << head + QString("%1").arg(i, w, 10, QChar('0')) + ta;
+    }
+    return out;
+}
+
+void CuMagicAgg::m_update(int i, const CuData &data) {
+    double x = std::numeric_limits<double>::quiet_NaN();
+    const CuVariant &v = data[CuDType::Value];  // data["value"]
+    if(!data[CuDType::Err].toBool() && v.isValid()) {  // data["err"]
+        if(v.getFormat() == CuVariant::Scalar)
+            v.to<double>(x);
+        else {
+            std::vector<double> vd;
+            if(v.toVector<double>(vd) && vd.size() > 0)
+                x = vd[0];
+        }
+    }
+    d->buf[i] = x;
+    if(!d->updated[i]) {
+        d->updated[i] = true;
+        d->n_updated++;
+    }
+    if(d->n_updated >= d->n_readers)
+        flush();
+    else if(!d->timer->isActive())
+        d->timer->start();
+}
+
+/*!
+ * \brief set the list of sources to aggregate
+ * \param srcs list of sources or source patterns, expanded with CuMagicAgg::expand
+ *
+ * The values in the target vector follow the order of the expanded sources. A source listed more
+ * than once is read once, at its first position.
+ */
+void CuMagicAgg::setSources(const QStringList &srcs) {
+    unsetSources();
+    QSet<QString> seen;
+    foreach(const QString& p, srcs)
+        foreach(const QString& s, expand(p)) {
+            if(!seen.contains(s)) {
+                seen.insert(s);
+                d->srcs << s;
+            }
+            else
+                perr("CuMagicAgg.setSources: source \"%s\" listed more than once: read once", qstoc(s));
+        }
+    d->buf.assign(d->srcs.size(), std::numeric_limits<double>::quiet_NaN());
+    d->updated.assign(d->srcs.size(), false);
+    for(int i = 0; i < d->srcs.size(); i++) {
+        CuMagicAggListener *l = new CuMagicAggListener(this, i);
+        CuControlsReaderA *r = d->context->add_reader(d->srcs[i].toStdString(), l);
+        if(r) {
+            r->setSource(d->srcs[i]);
+            d->listeners << l;
+            d->n_readers++;
+        }
+        else {
+            perr("CuMagicAgg.setSources: no reader for \"%s\": its value is NaN", qstoc(d->srcs[i]));
+            delete l;
+        }
+    }
+}
+
+void CuMagicAgg::unsetSources() {
+    d->timer->stop();
+    d->context->disposeReader(); // empty arg: dispose all
+    qDeleteAll(d->listeners);
+    d->listeners.clear();
+    d->srcs.clear();
+    d->buf.clear();
+    d->updated.clear();
+    d->n_updated = d->n_readers = 0;
+}
+
+QStringList CuMagicAgg::sources() const {
+    return d->srcs;
+}
+
+void CuMagicAgg::setFlushTimeout(int ms) {
+    d->timer->setInterval(ms);
+}
+
+int CuMagicAgg::flushTimeout() const {
+    return d->timer->interval();
+}
+
+QObject *CuMagicAgg::get_target_object() const {
+    return parent();
+}
+
+CuContext *CuMagicAgg::getContext() const {
+    return d->context;
+}
+
+/*!
+ * \brief write the buffer on the target property and start a new update cycle
+ */
+void CuMagicAgg::flush() {
+    d->timer->stop();
+    QObject *t = parent();
+    const QByteArray& p = d->t_prop.toLatin1();
+    QVector<double> out(static_cast<int>(d->buf.size()));
+    std::copy(d->buf.begin(), d->buf.end(), out.begin());
+    int pi = t->metaObject()->indexOfProperty(p.data());
+    bool ok;
+    if(pi > -1 && strcmp(t->metaObject()->property(pi).typeName(), "QList<double>") == 0)
+#if (QT_VERSION >= QT_VERSION_CHECK(5, 14, 0))
+        ok = t->setProperty(p.data(), QVariant::fromValue(QList<double>(out.begin(), out.end())));
+#else
+        ok = t->setProperty(p.data(), QVariant::fromValue(out.toList()));
+#endif
+    else
+        ok = t->setProperty(p.data(), QVariant::fromValue(out)) || pi < 0; // false for dynamic props
+    if(!ok)
+        perr("CuMagicAgg.flush: failed to set %d values on property \"%s\" of %s", out.size(), p.data(), qstoc(t->objectName()));
+    d->updated.assign(d->updated.size(), false);
+    d->n_updated = 0;
+    emit newData(out);
+}
@@ -0,0 +1,62 @@
+#ifndef CUMAGICAGG_H
+#define CUMAGICAGG_H
+
+#include <QObject>
+#include <QStringList>
+#include <cumagicplugininterface.h>
+
+class CuMagicAggPrivate;
+class CuData;
+class CuControlsFactoryPool;
+class CumbiaPool;
+
+/*!
+ * \brief CuMagicAgg collects the latest scalar value read from each of a list of sources into
+ *        a contiguous buffer and writes it as a single vector property on the target
+ *
+ * The target property can be either a QVector<double> or a QList<double>. If the property is not
+ * declared with Q_PROPERTY, a dynamic QVector<double> property is set.
+ *
+ * A *flush* writes the buffer on the target. It happens either when all the sources have been
+ * updated since the last flush or when the flush timeout expires after the first update of the
+ * cycle, whichever comes first. Sources that report an error contribute a *NaN*, as do the sources
+ * whose reader could not be created, which are not waited for.
+ *
+ * \par New data notification
+ * After each flush, the newData signal is emitted with the values written on the target
+ */
+class CuMagicAgg : public QObject, public CuMagicAggI
+{
+    Q_OBJECT
+public:
+    CuMagicAgg(QObject* target, CumbiaPool *cu_pool, const CuControlsFactoryPool &fpoo,
+               const QStringList& sources = QStringList(), const QString &property = QString());
+    ~CuMagicAgg();
+
+    static QStringList expand(const QString& pattern);
+
+    // CuMagicAggI interface
+public:
+    void setSources(const QStringList &srcs);
+    void unsetSources();
+    QStringList sources() const;
+    void setFlushTimeout(int ms);
+    int flushTimeout() const;
+    QObject *get_target_object() const;
+    CuContext *getContext() const;
+
+signals:
+    void newData(const QVector<double>& values);
+
+private slots:
+    void flush();
+
+private:
+    CuMagicAggPrivate *d;
+
+    void m_update(int i, const CuData &data);
+
+    friend class CuMagicAggListener;
+};
+
+#endif // CUMAGICAGG_H
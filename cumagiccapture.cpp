@@ -0,0 +1,325 @@
+#include "cumagiccapture.h"
+#include "cumagic.h"
+#include "cumagicraw.h"
+#include <cudata.h>
+#include <cumacros.h>
+#include <QTimer>
+#include <QtDebug>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+
+static const char cap_magic[8] = { 'C', 'U', 'M', 'A', 'G', 'C', 'A', 'P' };
+static const quint32 cap_version = 1;
+static const size_t cap_header_siz = 16;
+
+static inline size_t m_align8(size_t n) {
+    return (n + 7) & ~static_cast<size_t>(7);
+}
+
+CuMagicCapture::CuMagicCapture(QObject *parent) : QObject(parent)
+#if QT_VERSION < QT_VERSION_CHECK(5, 14, 0)
+  , m_mu(QMutex::Recursive) // a magic may create or delete magics while data is delivered
+#endif
+{
+    m_fd = -1;
+    m_wmap = m_rmap = nullptr;
+    m_wsiz = m_wpos = m_rsiz = m_rpos = 0;
+    m_speed = 1.0;
+    m_by_src_valid = false;
+    m_timer = new QTimer(this);
+    m_timer->setSingleShot(true);
+    connect(m_timer, SIGNAL(timeout()), this, SLOT(m_replay_next()));
+}
+
+CuMagicCapture::~CuMagicCapture() {
+    stopRecording();
+    stopReplay();
+}
+
+void CuMagicCapture::add(CuMagic *m) {
+    QMutexLocker lo(&m_mu);
+    if(!m_magics.contains(m))
+        m_magics.append(m);
+    m_by_src_valid = false;
+}
+
+void CuMagicCapture::remove(CuMagic *m) {
+    QMutexLocker lo(&m_mu);
+    m_magics.removeAll(m);
+    m_by_src_valid = false;
+}
+
+/*!
+ * \brief the source of one of the magics changed: replayed records are matched again by source
+ */
+void CuMagicCapture::sourceChanged() {
+    QMutexLocker lo(&m_mu);
+    m_by_src_valid = false;
+}
+
+/*!
+ * \brief map path and record the data received by the magics into it, until stopRecording or maxBytes are used
+ * \return false if a recording or a replay is in progress or the file cannot be created and mapped
+ */
+bool CuMagicCapture::startRecording(const QString &path, qint64 maxBytes) {
+    if(m_wmap || m_rmap || maxBytes < static_cast<qint64>(cap_header_siz)) {
+        perr("CuMagicCapture.startRecording: already recording or replaying, or size %lld too small", maxBytes);
+        return false;
+    }
+    m_fd = open(path.toLocal8Bit().data(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(m_fd < 0 || ftruncate(m_fd, maxBytes) < 0) {
+        perr("CuMagicCapture.startRecording: failed to create \"%s\" with size %lld: %s", qstoc(path), maxBytes, strerror(errno));
+        if(m_fd > -1) close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+    void *p = mmap(nullptr, maxBytes, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+    if(p == MAP_FAILED) {
+        perr("CuMagicCapture.startRecording: failed to map \"%s\": %s", qstoc(path), strerror(errno));
+        close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+    m_wmap = static_cast<char *>(p);
+    m_wsiz = maxBytes;
+    memcpy(m_wmap, cap_magic, sizeof(cap_magic));
+    memcpy(m_wmap + 8, &cap_version, sizeof(cap_version));
+    memset(m_wmap + 12, 0, 4);
+    m_wpos = cap_header_siz;
+    m_src_ids.clear();
+    m_rec_t.start();
+    return true;
+}
+
+/*!
+ * \brief unmap the capture and truncate the file to the size used
+ */
+void CuMagicCapture::stopRecording() {
+    if(!m_wmap)
+        return;
+    munmap(m_wmap, m_wsiz);
+    if(ftruncate(m_fd, m_wpos) < 0)
+        perr("CuMagicCapture.stopRecording: failed to truncate capture to %zu bytes: %s", m_wpos, strerror(errno));
+    close(m_fd);
+    m_fd = -1;
+    m_wmap = nullptr;
+    m_wsiz = m_wpos = 0;
+}
+
+bool CuMagicCapture::recording() const {
+    return m_wmap != nullptr;
+}
+
+// true if n more bytes fit into the capture. Otherwise recording stops
+bool CuMagicCapture::m_reserve(size_t n) {
+    if(m_wpos + n <= m_wsiz)
+        return true;
+    perr("CuMagicCapture: capture full after %zu bytes: recording stopped", m_wpos);
+    stopRecording();
+    return false;
+}
+
+/*!
+ * \brief append da, received by the magic with source src, to the capture
+ */
+void CuMagicCapture::record(const QString &src, const CuData &da) {
+    if(!m_wmap)
+        return;
+    quint32 kd[2];
+    quint32 id = m_src_ids.value(src, m_src_ids.size());
+    if(id == static_cast<quint32>(m_src_ids.size())) { // new source: source record
+        const QByteArray& name = src.toUtf8();
+        const size_t siz = m_align8(sizeof(kd) + sizeof(id) + name.size() + 1);
+        if(!m_reserve(siz))
+            return;
+        kd[0] = KSource;
+        kd[1] = siz;
+        char *p = m_wmap + m_wpos;
+        memcpy(p, kd, sizeof(kd));
+        memcpy(p + sizeof(kd), &id, sizeof(id));
+        memcpy(p + sizeof(kd) + sizeof(id), name.constData(), name.size() + 1);
+        m_wpos += siz;
+        m_src_ids.insert(src, id);
+    }
+    const CuVariant &v = da[CuDType::Value];  // da["value"]
+    const std::string& msg = da.s(CuDType::Message);  // da.s("msg")
+    DataRec r;
+    memset(&r, 0, sizeof(r));
+    r.t_ns = m_rec_t.nsecsElapsed();
+    if(da.containsKey(CuDType::Time_ms))  // da.containsKey("timestamp_ms")
+        da[CuDType::Time_ms].to<qint64>(r.ts_ms);
+    r.src = id;
+    r.type = v.getType();
+    r.format = v.getFormat();
+    r.flags = (da[CuDType::Err].toBool() ? FErr : 0) | (da.s(CuDType::Type) == "property" ? FProperty : 0);  // da["err"], da["type"]
+    if(da.containsKey(CuDType::Min) && da.containsKey(CuDType::Max)) {  // da.containsKey("min"), da.containsKey("max")
+        da[CuDType::Min].to<double>(r.min);
+        da[CuDType::Max].to<double>(r.max);
+        r.flags |= FMinMax;
+    }
+    size_t nr = 0, nc = 0;
+    const void *raw = v.isValid() ? CuMagicRaw::data(v, &nr, &nc) : nullptr;
+    std::vector<std::string> sv;
+    size_t dlen = 0;
+    if(raw)
+        dlen = nr * nc * CuMagicRaw::elem_size(v.getType());
+    else if(v.isValid() && v.getType() == CuVariant::String) {
+        sv = v.toStringVector();
+        nr = 1;
+        nc = sv.size();
+        for(size_t i = 0; i < sv.size(); i++)
+            dlen += sv[i].size() + 1;
+    }
+    r.nrows = nr;
+    r.ncols = nc;
+    r.msg_len = msg.size();
+    r.data_len = dlen;
+    const size_t siz = m_align8(sizeof(kd) + sizeof(r) + r.msg_len + dlen);
+    if(!m_reserve(siz))
+        return;
+    kd[0] = KData;
+    kd[1] = siz;
+    char *p = m_wmap + m_wpos;
+    memcpy(p, kd, sizeof(kd));
+    p += sizeof(kd);
+    memcpy(p, &r, sizeof(r));
+    p += sizeof(r);
+    memcpy(p, msg.data(), r.msg_len);
+    p += r.msg_len;
+    if(raw)
+        memcpy(p, raw, dlen);
+    else
+        for(size_t i = 0; i < sv.size(); i++) {
+            memcpy(p, sv[i].c_str(), sv[i].size() + 1);
+            p += sv[i].size() + 1;
+        }
+    m_wpos += siz;
+}
+
+/*!
+ * \brief map the capture at path and deliver its records to the magics
+ * \param speed 1: original timing, 2: twice as fast... 0: as fast as possible
+ * \return false if a recording or a replay is in progress or the file is not a capture
+ */
+bool CuMagicCapture::startReplay(const QString &path, double speed) {
+    if(m_wmap || m_rmap) {
+        perr("CuMagicCapture.startReplay: already recording or replaying");
+        return false;
+    }
+    int fd = open(path.toLocal8Bit().data(), O_RDONLY);
+    struct stat st;
+    if(fd < 0 || fstat(fd, &st) < 0 || st.st_size < static_cast<off_t>(cap_header_siz)) {
+        perr("CuMagicCapture.startReplay: failed to open \"%s\": %s", qstoc(path), fd < 0 ? strerror(errno) : "file too short");
+        if(fd > -1) close(fd);
+        return false;
+    }
+    void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // the mapping stays valid
+    if(p == MAP_FAILED || memcmp(p, cap_magic, sizeof(cap_magic)) != 0) {
+        perr("CuMagicCapture.startReplay: \"%s\" is not a capture", qstoc(path));
+        if(p != MAP_FAILED) munmap(p, st.st_size);
+        return false;
+    }
+    m_rmap = static_cast<char *>(p);
+    m_rsiz = st.st_size;
+    m_rpos = cap_header_siz;
+    m_speed = std::max(speed, 0.0);
+    m_src_names.clear();
+    m_play_t.start();
+    m_timer->start(0);
+    return true;
+}
+
+void CuMagicCapture::stopReplay() {
+    m_timer->stop();
+    if(m_rmap)
+        munmap(m_rmap, m_rsiz);
+    m_rmap = nullptr;
+    m_rsiz = m_rpos = 0;
+}
+
+bool CuMagicCapture::replaying() const {
+    return m_rmap != nullptr;
+}
+
+/*
+ * deliver the records that are due. With the original (or scaled) timing, wait for the next one.
+ * At maximum speed, give the event loop a chance every 10ms
+ */
+void CuMagicCapture::m_replay_next() {
+    QElapsedTimer slice;
+    slice.start();
+    quint32 kd[2];
+    while(m_rmap && m_rpos + sizeof(kd) <= m_rsiz) {
+        memcpy(kd, m_rmap + m_rpos, sizeof(kd));
+        const char *p = m_rmap + m_rpos + sizeof(kd);
+        if(kd[1] < sizeof(kd) || m_rpos + kd[1] > m_rsiz) {
+            perr("CuMagicCapture: corrupt record at offset %zu: replay stopped", m_rpos);
+            break;
+        }
+        if(kd[0] == KSource) {
+            quint32 id;
+            memcpy(&id, p, sizeof(id));
+            m_src_names.insert(id, QString::fromUtf8(p + sizeof(id)));
+        }
+        else if(kd[0] == KData) {
+            DataRec r;
+            memcpy(&r, p, sizeof(r));
+            if(m_speed > 0) {
+                const qint64 due_ns = static_cast<qint64>(r.t_ns / m_speed), now = m_play_t.nsecsElapsed();
+                if(due_ns > now) { // come back later
+                    m_timer->start(static_cast<int>((due_ns - now) / 1000000));
+                    return;
+                }
+            }
+            else if(slice.elapsed() >= 10) {
+                m_timer->start(0);
+                return;
+            }
+            m_deliver(r, p + sizeof(r), p + sizeof(r) + r.msg_len);
+        }
+        m_rpos += kd[1];
+    }
+    stopReplay();
+    emit replayFinished();
+}
+
+void CuMagicCapture::m_deliver(const DataRec &r, const char *msg, const char *data) {
+    const QString& src = m_src_names.value(r.src);
+    CuData da(CuDType::Src, src.toStdString());  // CuData("src", ...)
+    CuVariant v;
+    if(r.type == CuVariant::String) {
+        std::vector<std::string> sv;
+        for(const char *s = data; s < data + r.data_len; s += strlen(s) + 1)
+            sv.push_back(std::string(s));
+        v = r.format == CuVariant::Scalar && sv.size() == 1 ? CuVariant(sv[0]) : CuVariant(sv);
+    }
+    else
+        v = CuMagicRaw::variant(r.type, r.format, data, r.nrows, r.ncols);
+    da.set(CuDType::Value, v);  // da["value"]
+    da.set(CuDType::Err, (r.flags & FErr) != 0);  // da["err"]
+    da.set(CuDType::Message, std::string(msg, r.msg_len));  // da["msg"]
+    if(r.ts_ms)
+        da.set(CuDType::Time_ms, r.ts_ms);  // da["timestamp_ms"]
+    if(r.flags & FProperty)
+        da.set(CuDType::Type, std::string("property"));  // da["type"]
+    if(r.flags & FMinMax) {
+        da.set(CuDType::Min, r.min);  // da["min"]
+        da.set(CuDType::Max, r.max);  // da["max"]
+    }
+    // delivered with the lock held: a headless magic cannot be destroyed in the meantime
+    QMutexLocker lo(&m_mu);
+    if(!m_by_src_valid) {
+        m_by_src.clear();
+        foreach(CuMagic *m, m_magics)
+            m_by_src[m->m_replay_source()].append(m);
+        m_by_src_valid = true;
+    }
+    const QList<CuMagic *> ms = m_by_src.value(src); // a copy: onUpdate may add or remove magics
+    foreach(CuMagic *m, ms)
+        m->onUpdate(da);
+}
@@ -0,0 +1,115 @@
+#ifndef CUMAGICCAPTURE_H
+#define CUMAGICCAPTURE_H
+
+#include <QObject>
+#include <QHash>
+#include <QList>
+#include <QPointer>
+#include <QString>
+#include <QElapsedTimer>
+#include <QMutex>
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+#include <QRecursiveMutex>
+#endif
+
+class CuMagic;
+class CuData;
+class QTimer;
+
+/*!
+ * \brief CuMagicCapture records the data received by the magics into a memory mapped capture file and
+ *        replays a capture into the magics, without any control system
+ *
+ * \par Recording
+ * startRecording maps a file of the given size. Each CuData reaching a magic is appended as a record:
+ * time since the start of the recording, data timestamp, source id, type, format, flags (error, property),
+ * message, min and max (property data) and the raw bytes of the value, copied straight from the storage
+ * of the value into the mapped file. Sources are written once, the first time they appear. Recording
+ * stops when the file is full. stopRecording truncates the file to the size used.
+ *
+ * \par Replay
+ * startReplay maps a capture and delivers each record to the magics whose source (as given to setSource)
+ * matches the recorded one, with the original timing divided by *speed*. With speed 0, records are
+ * delivered as fast as possible, in slices of about 10ms per event loop cycle. replayFinished is emitted
+ * at the end of the capture. Replayed data keeps its recorded timestamp: the magics do not record
+ * latencies while a capture is replayed.
+ *
+ * \par File layout
+ * A 16 bytes header, "CUMAGCAP", version (quint32), reserved (quint32), followed by records aligned to
+ * 8 bytes. Each record starts with kind (quint32, 0 source, 1 data) and size (quint32, the whole record
+ * including padding). A source record holds the id (quint32) and the name. A data record holds a
+ * CuMagicCapture::DataRec, the message and the value bytes. Strings are stored as a sequence of
+ * nul terminated strings. Byte order and type sizes are those of the host.
+ */
+class CuMagicCapture : public QObject
+{
+    Q_OBJECT
+public:
+    enum Kind { KSource = 0, KData };
+    enum Flags { FErr = 0x1, FProperty = 0x2, FMinMax = 0x4 };
+
+    struct DataRec {
+        qint64 t_ns; // since the start of the recording
+        qint64 ts_ms; // data timestamp, 0 if missing
+        quint32 src; // source id
+        quint16 type; // CuVariant::DataType
+        quint8 format; // CuVariant::DataFormat
+        quint8 flags; // Flags
+        quint32 nrows, ncols;
+        quint32 msg_len, data_len; // bytes following this struct
+        double min, max;
+    };
+
+    CuMagicCapture(QObject *parent);
+    ~CuMagicCapture();
+
+    void add(CuMagic *m);
+    void remove(CuMagic *m);
+    void sourceChanged();
+
+    bool startRecording(const QString& path, qint64 maxBytes);
+    void stopRecording();
+    bool recording() const;
+    void record(const QString& src, const CuData& da);
+
+    bool startReplay(const QString& path, double speed);
+    void stopReplay();
+    bool replaying() const;
+
+signals:
+    void replayFinished();
+
+private slots:
+    void m_replay_next();
+
+private:
+    bool m_reserve(size_t n);
+    void m_deliver(const DataRec& r, const char *msg, const char *data);
+
+    // headless magics add and remove themselves from the thread of their target
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+    QRecursiveMutex m_mu;
+#else
+    QMutex m_mu; // recursive, see constructor
+#endif
+    QList<CuMagic *> m_magics;
+    QHash<QString, QList<CuMagic *> > m_by_src; // m_magics by source, see m_replay_next
+    bool m_by_src_valid;
+
+    // recording
+    int m_fd;
+    char *m_wmap;
+    size_t m_wsiz, m_wpos;
+    QHash<QString, quint32> m_src_ids;
+    QElapsedTimer m_rec_t;
+
+    // replay
+    char *m_rmap;
+    size_t m_rsiz, m_rpos;
+    double m_speed;
+    QHash<quint32, QString> m_src_names;
+    QElapsedTimer m_play_t;
+    QTimer *m_timer;
+};
+
+#endif // CUMAGICCAPTURE_H
@@ -0,0 +1,124 @@
+#include "cumagichistogram.h"
+#include <QMutexLocker>
+#include <QtAlgorithms>
+#include <string.h>
+#include <cmath>
+
+CuMagicHistogram::CuMagicHistogram() {
+    reset();
+}
+
+// values below SubBuckets map to themselves, then SubBuckets buckets per power of two
+int CuMagicHistogram::m_bucket(quint64 us) {
+    if(us < SubBuckets)
+        return static_cast<int>(us);
+    const int msb = 63 - __builtin_clzll(us); // >= SubBits
+    const int sub = static_cast<int>((us >> (msb - SubBits)) & (SubBuckets - 1));
+    const int i = (msb - SubBits + 1) * SubBuckets + sub;
+    return i < Buckets ? i : Buckets - 1;
+}
+
+/*!
+ * \brief the lowest value, in microseconds, counted in bucket i
+ */
+double CuMagicHistogram::bucketLow(int i) {
+    if(i < SubBuckets)
+        return i;
+    const int msb = i / SubBuckets + SubBits - 1, sub = i % SubBuckets;
+    return std::ldexp(1.0, msb) + sub * std::ldexp(1.0, msb - SubBits);
+}
+
+void CuMagicHistogram::record(qint64 us) {
+    m_c[m_bucket(us > 0 ? static_cast<quint64>(us) : 0)]++;
+    m_n++;
+}
+
+void CuMagicHistogram::reset() {
+    memset(m_c, 0, sizeof(m_c));
+    m_n = 0;
+}
+
+quint64 CuMagicHistogram::count() const {
+    return m_n;
+}
+
+/*!
+ * \brief the value below which the fraction p (0 to 1) of the recorded values falls, in microseconds
+ *
+ * The lower bound of the bucket is returned. -1 if nothing has been recorded
+ */
+double CuMagicHistogram::percentile(double p) const {
+    if(m_n == 0)
+        return -1;
+    const quint64 target = static_cast<quint64>(std::ceil(std::min(std::max(p, 0.0), 1.0) * m_n));
+    quint64 acc = 0;
+    for(int i = 0; i < Buckets; i++) {
+        acc += m_c[i];
+        if(acc >= target && acc > 0)
+            return bucketLow(i);
+    }
+    return bucketLow(Buckets - 1);
+}
+
+/*!
+ * \brief the Buckets counters. See bucketLow for the lower bound of each
+ */
+QVector<quint64> CuMagicHistogram::buckets() const {
+    QVector<quint64> v(Buckets);
+    for(int i = 0; i < Buckets; i++)
+        v[i] = m_c[i];
+    return v;
+}
+
+CuMagicLatency::~CuMagicLatency() {
+    qDeleteAll(m_h);
+}
+
+/*!
+ * \brief the entry of src, created on first use. Valid as long as this object
+ */
+CuMagicLatency::Entry *CuMagicLatency::entry(const QString &src) {
+    QMutexLocker lo(&m_mu);
+    Entry *&e = m_h[src];
+    if(!e)
+        e = new Entry;
+    return e;
+}
+
+void CuMagicLatency::record(Entry *e, qint64 dispatch_us, qint64 write_us) {
+    QMutexLocker lo(&e->mu);
+    e->h[Dispatch].record(dispatch_us);
+    e->h[Write].record(write_us);
+}
+
+void CuMagicLatency::reset() {
+    QMutexLocker lo(&m_mu);
+    foreach(Entry *e, m_h) {
+        QMutexLocker elo(&e->mu);
+        e->h[Dispatch].reset();
+        e->h[Write].reset();
+    }
+}
+
+/*!
+ * \brief the sources with at least one update recorded since the last reset
+ */
+QStringList CuMagicLatency::sources() const {
+    QMutexLocker lo(&m_mu);
+    QStringList l;
+    for(QHash<QString, Entry *>::const_iterator it = m_h.constBegin(); it != m_h.constEnd(); ++it) {
+        QMutexLocker elo(&it.value()->mu);
+        if(it.value()->h[Dispatch].count() > 0)
+            l << it.key();
+    }
+    return l;
+}
+
+CuMagicHistogram CuMagicLatency::histogram(const QString &src, int stage) const {
+    QMutexLocker lo(&m_mu);
+    Entry *e = m_h.value(src, nullptr);
+    if(!e || stage < 0 || stage >= EndStages)
+        return CuMagicHistogram();
+    QMutexLocker elo(&e->mu);
+    return e->h[stage];
+}
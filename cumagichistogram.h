@@ -0,0 +1,70 @@
+#ifndef CUMAGICHISTOGRAM_H
+#define CUMAGICHISTOGRAM_H
+
+#include <QtGlobal>
+#include <QVector>
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include <QMutex>
+
+/*!
+ * \brief CuMagicHistogram is a fixed size log-linear histogram of latencies, in microseconds
+ *
+ * Values below 8us have one bucket each. Above, each power of two range [2^k, 2^(k+1)) is split into
+ * 8 linear buckets, up to 2^34 us (about 4.8 hours), so that the relative error of a percentile is
+ * within 1/8. The whole histogram is 256 32 bit counters (1kB): recording is one bit scan and one
+ * increment.
+ */
+class CuMagicHistogram
+{
+public:
+    enum { SubBits = 3, SubBuckets = 1 << SubBits, Buckets = 256 };
+
+    CuMagicHistogram();
+
+    void record(qint64 us);
+    void reset();
+    quint64 count() const;
+    double percentile(double p) const;
+    QVector<quint64> buckets() const;
+    static double bucketLow(int i);
+
+private:
+    static int m_bucket(quint64 us);
+
+    quint32 m_c[Buckets];
+    quint64 m_n;
+};
+
+/*!
+ * \brief CuMagicLatency collects the latencies of all the magics of the plugin, by source
+ *
+ * Magics in different threads (see CuMagicPluginInterface::new_magic_headless) may record concurrently.
+ * A magic resolves the Entry of its source once, in setSource, and records into it holding only the
+ * entry lock. Entries are never removed, so that the pointers stay valid: reset clears their counters
+ */
+class CuMagicLatency
+{
+public:
+    enum Stage { Dispatch = 0, Write, EndStages };
+
+    struct Entry {
+        CuMagicHistogram h[EndStages];
+        QMutex mu;
+    };
+
+    ~CuMagicLatency();
+
+    Entry *entry(const QString& src);
+    static void record(Entry *e, qint64 dispatch_us, qint64 write_us);
+    void reset();
+    QStringList sources() const;
+    CuMagicHistogram histogram(const QString& src, int stage) const;
+
+private:
+    QHash<QString, Entry *> m_h;
+    mutable QMutex m_mu;
+};
+
+#endif // CUMAGICHISTOGRAM_H
@@ -4,6 +4,12 @@
 #include <QObject>
 #include <cupluginloader.h>
 #include <cumacros.h>
+#include <cudata.h>
+#include <QVector>
+#include <QStringList>
+#include <limits>
+
+typedef unsigned int QRgb; // as in <QRgb>, without QtGui: headless users need not link it
 
 class Cumbia;
 class CumbiaPool;
@@ -26,8 +32,40 @@ public:
 
 class CuMagicI {
 public:
+    /*!
+     * \brief how a block of matrix elements is reduced by setBinning
+     */
+    enum BinMode { BinMean, BinMax, BinSubsample };
+
+    /*!
+     * \brief from the timestamp of the data to the start of the dispatch to the target (LatencyDispatch)
+     *        or to the end of the property writes (LatencyWrite)
+     */
+    enum LatencyStage { LatencyDispatch = 0, LatencyWrite };
+
+    /*!
+     * \brief the state of a target according to the warning and alarm thresholds, see setThresholds
+     */
+    enum AlarmState { StateValid = 0, StateWarning, StateAlarm };
+
     virtual ~CuMagicI() {}
 
+    /*!
+     * \brief timestamp_us the timestamp of da in microseconds since the epoch, 0 if missing
+     *
+     * As in the cumbia engines, *timestamp_us* holds seconds with a microsecond fraction, *timestamp_ms*
+     * milliseconds. The former is used if available
+     */
+    static qint64 timestamp_us(const CuData& da) {
+        double s = 0.0;
+        qint64 ms = 0;
+        if(da.containsKey(CuDType::Time_us) && da[CuDType::Time_us].to<double>(s) && s > 0)  // da["timestamp_us"]
+            return static_cast<qint64>(s * 1e6 + 0.5);
+        if(da.containsKey(CuDType::Time_ms) && da[CuDType::Time_ms].to<qint64>(ms))  // da["timestamp_ms"]
+            return ms * 1000;
+        return 0;
+    }
+
     /** \brief set the source to read from.
      *
      * \note Calling this method replaces the existing source with the new ones
@@ -116,6 +154,245 @@ public:
      *         key is not found within the configuration data.
      */
     virtual QString display_unit() const = 0;
+
+    /*!
+     * \brief setTransform apply a calibration to numeric values before they are set on the target
+     * \param scale multiply each value by scale
+     * \param offset then add offset
+     * \param clampMin then limit the result to be not less than clampMin
+     * \param clampMax and not greater than clampMax
+     *
+     * The transformation is applied *in place* on the data already converted for the target,
+     * before the value reaches the object. Boolean and string data are not transformed.
+     */
+    virtual void setTransform(double scale, double offset,
+                              double clampMin = -std::numeric_limits<double>::infinity(),
+                              double clampMax = std::numeric_limits<double>::infinity()) = 0;
+
+    /*!
+     * \brief clearTransform remove the transformation set with setTransform
+     */
+    virtual void clearTransform() = 0;
+
+    /*!
+     * \brief setImageRange set the values mapped to the first and last entries of the colormap
+     *        when matrix data is displayed as an image
+     * \param min the value mapped to the first color
+     * \param max the value mapped to the last color
+     *
+     * If min is not less than max, minimum and maximum are computed on each frame (default)
+     */
+    virtual void setImageRange(double min, double max) = 0;
+
+    /*!
+     * \brief setColormap set the colors used when matrix data is displayed as an image
+     * \param lut a table of 256 colors, e.g. built with qRgb from <QRgb>. Default: gray scale
+     */
+    virtual void setColormap(const QVector<QRgb>& lut) = 0;
+
+    /*!
+     * \brief setBinning reduce matrix data by blocks of rows x cols elements before it is delivered
+     * \param rows the number of rows of a block. 0: the block height is chosen so that the result
+     *        fits the height of the target widget
+     * \param cols the number of columns of a block. 0: as above, with the width of the widget
+     * \param mode replace each block with its mean, its maximum or its top left element
+     *
+     * Binning applies to the region of interest, if specified in the source, and to both CuMatrix and
+     * image targets. Default: 1 x 1 blocks, no binning.
+     */
+    virtual void setBinning(int rows, int cols, BinMode mode = BinMean) = 0;
+
+    /*!
+     * \brief setDecimation reduce long vectors set on QVector<T> or QList<T> properties, keeping the peaks
+     * \param points the number of values to deliver: 0 disables decimation (default), -1 uses twice the width
+     *        of the target widget
+     *
+     * The data is split into points / 2 buckets and the minimum and maximum of each bucket are kept, in their
+     * original order. The indexes of the values kept are set on the property *x* is mapped to with mapProperty,
+     * if any, so that a plot can draw them at the right abscissa:
+     *
+     * \code
+       CuMagicI *ma = plugin_i->new_magic(ui->plot, "$1/double_spectrum_ro", "yData");
+       ma->mapProperty("x", "xData");
+       ma->setDecimation(-1);
+     * \endcode
+     */
+    virtual void setDecimation(int points) = 0;
+
+    /*!
+     * \brief setRangeUpdateThreshold deliver only the changed parts of vectors to targets that support it
+     * \param fraction if more than this fraction of the values changed, the whole vector is set on the
+     *        property. 0 disables range updates. Default: 0.25
+     *
+     * If the target of a QVector<T> or QList<T> property declares an invokable method
+     *
+     * \code
+       Q_INVOKABLE void updateRange(int offset, const QVector<double>& values); // QVector<int> for int properties
+     * \endcode
+     *
+     * the new data is compared with the last vector applied and updateRange is called once for each run of
+     * changed values. The first vector and vectors whose size changes are always set on the property.
+     * Data that does not change at all is not delivered.
+     */
+    virtual void setRangeUpdateThreshold(double fraction) = 0;
+
+    /*!
+     * \brief setDynamicVariantList deliver vectors to dynamic properties as QVariantList
+     * \param vlist true: one QVariant per element, as in earlier versions. false (default): a packed QVector<T>
+     *
+     * When the target does not declare the property, vectors are set as a dynamic property holding a
+     * QVector<T>, with T double, float, int, long long, unsigned int, unsigned long long, short,
+     * unsigned short or bool, according to the data type (QVector<double> if a transform is set).
+     * Enable this compatibility mode for readers that expect a QVariantList, at the cost of boxing
+     * each element into its own QVariant.
+     */
+    virtual void setDynamicVariantList(bool vlist) = 0;
+
+    /*!
+     * \brief setErrorBackoff lower the read frequency of a failing source
+     * \param maxPeriodMs the longest polling period, in milliseconds. 0: no backoff (default)
+     *
+     * On each error, the polling period is doubled, up to maxPeriodMs. The first successful read restores
+     * the period set in the context options (1000ms if not set).
+     *
+     * \note Regardless of the backoff, errors are shown on the target once per error/recovery transition:
+     *       while a source keeps failing, a different error message replaces the former at most once a second
+     */
+    virtual void setErrorBackoff(int maxPeriodMs) = 0;
+
+    /*!
+     * \brief setLazyConnect defer the connection to the source until the target is shown
+     * \param lazy if true, the reader is created the first time the target widget, or one of the objects
+     *        mapped with map, becomes visible. Targets that are not widgets are connected immediately
+     * \param disconnectAfterMs if greater than zero, the reader is disposed after all the target widgets
+     *        have been hidden for this time and it is created again as soon as one of them is shown
+     *
+     * Call setLazyConnect before setSource, or use CuMagicPluginInterface::setLazyConnect, so that a panel
+     * with many tabs subscribes only to the sources on screen.
+     */
+    virtual void setLazyConnect(bool lazy, int disconnectAfterMs = 0) = 0;
+
+    /*!
+     * \brief setAdaptivePeriod poll static sources less often
+     * \param maxPeriodMs the longest polling period, in milliseconds. 0: fixed period (default)
+     * \param unchanged after this number of equal values in a row, the polling period is doubled
+     *
+     * The first value that differs from the previous one restores the period set in the context options
+     * (1000ms if not set). The period is changed through CuContext::sendData, so only polled sources are
+     * affected.
+     */
+    virtual void setAdaptivePeriod(int maxPeriodMs, int unchanged = 5) = 0;
+
+    /*!
+     * \brief setThresholds evaluate the warning and alarm state of each target on every update
+     * \param minWarning maxWarning values at or beyond these limits are in warning state
+     * \param minAlarm maxAlarm values at or beyond these limits are in alarm state
+     * \param hysteresis a value must be within the limits by this amount to return to a lower state
+     *
+     * Pass NaN for the limits that do not apply. If no threshold is set here, those in the configuration
+     * data (*min_warning*, *max_warning*, *min_alarm*, *max_alarm*) are used. Values are compared before
+     * setTransform. A target mapped with map uses its first element.
+     *
+     * The target is restyled only when its state changes: the dynamic property *cumagic_alarm_state* is set
+     * to the AlarmState, then the style sheet given with setAlarmStyleSheet for the new state, if any, is set on
+     * widgets. Otherwise, the widget style is polished again, so that the rules of the application style sheet
+     * selecting on the property apply, e.g.
+     *
+     * \code
+       QLCDNumber[cumagic_alarm_state="2"] { background-color: red; }
+     * \endcode
+     *
+     * The *alarmStateChanged(QObject *target, int state)* signal of the magic is emitted on each transition.
+     */
+    virtual void setThresholds(double minWarning, double maxWarning, double minAlarm, double maxAlarm, double hysteresis = 0.0) = 0;
+
+    /*!
+     * \brief setAlarmStyleSheet the style sheet set on widget targets entering state
+     *
+     * See setThresholds
+     */
+    virtual void setAlarmStyleSheet(AlarmState state, const QString& styleSheet) = 0;
+
+    /*!
+     * \brief alarmState the current AlarmState of target (the magic target if nullptr)
+     */
+    virtual AlarmState alarmState(QObject *target = nullptr) const = 0;
+
+    /*!
+     * \brief latencyPercentile the latency below which the fraction p of the updates fall
+     * \param stage up to the start of the dispatch or up to the end of the property writes
+     * \param p between 0 and 1, e.g. 0.99
+     * \return microseconds, within 1/8 of the exact value. -1 if no data with a timestamp has been
+     *         applied since the last resetLatency
+     *
+     * Latencies are measured from the *timestamp_us* (or *timestamp_ms*) of the data. If the engine clock
+     * and the local clock differ, the values include the offset.
+     */
+    virtual double latencyPercentile(LatencyStage stage, double p) const = 0;
+
+    /*!
+     * \brief latencyHistogram the 256 counters of the log-linear latency histogram of stage
+     *
+     * Counter i < 8 counts the latencies of i microseconds. Above, with m = i / 8 + 2, counter i counts
+     * latencies from 2^m + (i % 8) * 2^(m - 3) microseconds, up to the start of counter i + 1
+     */
+    virtual QVector<quint64> latencyHistogram(LatencyStage stage) const = 0;
+
+    /*!
+     * \brief resetLatency clear the latency histograms of this magic
+     */
+    virtual void resetLatency() = 0;
+};
+
+/*!
+ * \brief The CuMagicAggI class is the interface to a magic that aggregates the scalar values
+ *        read from several sources into a single vector property of the target
+ *
+ * \see CuMagicPluginInterface::new_magic_agg
+ */
+class CuMagicAggI {
+public:
+    virtual ~CuMagicAggI() {}
+
+    /*!
+     * \brief set the list of sources to aggregate
+     * \param srcs the sources. Each of them can be a pattern with one or more ranges between square
+     *        brackets, e.g. *$1/bpm[0-63]/x* expands into *$1/bpm0/x*, ..., *$1/bpm63/x*
+     *
+     * \note Calling this method replaces the existing sources with the new ones
+     */
+    virtual void setSources(const QStringList& srcs) = 0;
+
+    /** \brief Remove all the readers.
+     */
+    virtual void unsetSources() = 0;
+
+    /*!
+     * \brief the expanded list of sources, in the order their values appear in the target vector
+     */
+    virtual QStringList sources() const = 0;
+
+    /*!
+     * \brief set the maximum time elapsed since the first update of a cycle before the vector is
+     *        written on the target, even if not all the sources have been updated yet
+     * \param ms the timeout in milliseconds
+     */
+    virtual void setFlushTimeout(int ms) = 0;
+
+    /*!
+     * \brief returns the flush timeout, in milliseconds
+     */
+    virtual int flushTimeout() const = 0;
+
+    /*!
+     * \brief get_target_object returns the QObject used in CuMagicPluginInterface::new_magic_agg
+     */
+    virtual QObject *get_target_object() const = 0;
+
+    /*!
+     * \brief get the context used by the readers
+     */
+    virtual CuContext *getContext() const = 0;
 };
 
 
@@ -216,6 +493,32 @@ public:
 
  * \endcode
  *
+ * A region of interest can be selected from matrix data, with one range (*from:to*, *to* excluded) or one index
+ * for the rows and one for the columns. Only the selected region is copied and delivered to the target:
+ *
+ * \code
+   // rows 100 to 163, columns 200 to 263
+   CuMagicI *ma_roi = plugin_i->new_magic(ui->matrixView, "$1/double_image_ro[100:164, 200:264]", "myData");
+   // row 5, all columns
+   CuMagicI *ma_row = plugin_i->new_magic(ui->rowView, "$1/double_image_ro[5, :]", "myData");
+ * \endcode
+ *
+ * The bits of an integer status word can drive many boolean targets from a single reader with a bit selector,
+ * *[bit:...]*, followed by *map(index, object)*. Each bit is extracted with a shift and a mask and only the targets
+ * whose bits flipped since the last update are written:
+ *
+ * \code
+   CuMagicI *ma_leds = plugin_i->new_magic(this, "$1/status[bit:0-31]");
+   for(int i = 0; i < 32; i++)
+       ma_leds->map(i, QString("led%1").arg(i)); // i-th selected bit on the *value* (or *checked*, *text*) of "led<i>"
+ * \endcode
+ *
+ * Mapped indexes refer to the selected bits, as indexes refer to the selected elements of a vector: with
+ * *[bit:8-15]*, *map(0, "led0")* drives "led0" with bit 8. An index outside the selector is an error.
+ * An object mapped to several bits receives them packed into an unsigned integer, the first mapped bit being
+ * the least significant. Without map, the target receives the selected bits in the same way (a bool if only
+ * one bit is selected). Bits apply to integer and boolean scalars, or to the first element of a vector.
+ *
  * \subsection Default properties
  *
  * Elements of a vectorial quantity can be displayed each on dedicated widgets:
@@ -254,6 +557,20 @@ public:
  * *read action* underneath. In other words, only one read operation serves CuMagic's m0 to
  * m4 updates at the same time.
  *
+ * \subsection agg Scalar values from many sources on a vector property
+ *
+ * The scalar values read from a list of sources can be packed into one vector, that is set on a
+ * QVector<double> or QList<double> property of the target:
+ *
+ * \code
+   // one bar per bpm: $1/bpm0/x, $1/bpm1/x, ..., $1/bpm63/x
+   CuMagicAggI *agg = plugin_i->new_magic_agg(ui->barChart, QStringList() << "$1/bpm[0-63]/x", "values");
+   agg->setFlushTimeout(200);
+ * \endcode
+ *
+ * The property is set once all the sources have been updated or when the flush timeout expires,
+ * whichever comes first.
+ *
  *
  * \subsection def_prop Default properties
  *
@@ -291,6 +608,18 @@ public:
  * If the CuMagic targets a property not defined with the Q_PROPERTY macro, then a dynamic property is added to the
  * object and its type will be in accord with the data type.
  *
+ * \subsubsection image_prop Matrix data as an image
+ *
+ * Numeric matrix data is converted into an image if the target property is a QImage or a QPixmap, or if the target
+ * is a QLabel and no property is specified (the image is set with QLabel::setPixmap).
+ * Values are normalised between the range set with CuMagicI::setImageRange (or the minimum and maximum of each frame)
+ * and mapped through a 256 entries colormap (CuMagicI::setColormap).
+ *
+ * \code
+   CuMagicI *cam = plugin_i->new_magic(ui->label, "$1/double_image_ro");
+   cam->setImageRange(0, 1000);
+ * \endcode
+ *
  * \subsubsection def_prop_config On configuration
  *
  * On configuration (when CuData *type* equals *property*), the following default properties are searched on the
@@ -339,6 +668,163 @@ public:
      */
     virtual CuMagicI *new_magic(QObject* target, const QString& source = QString(), const QString& property = QString()) const = 0;
 
+    /*!
+     * \brief new_magic_agg returns a new CuMagicAggI, that packs the scalar values read from each of the
+     *        sources into one vector property of the target
+     * \param target the object used as target to display the read values
+     * \param sources the list of sources (or source patterns, see CuMagicAggI::setSources)
+     * \param property the name of the vector property. If empty, *value* is used
+     * \return a *new* instance of an object implementing CuMagicAggI interface
+     */
+    virtual CuMagicAggI *new_magic_agg(QObject* target, const QStringList& sources = QStringList(), const QString& property = QString()) const = 0;
+
+    /*!
+     * \brief new_magic_headless returns a new CuMagicI for a target that is not a widget and may live in
+     *        any thread, e.g. a QObject moved to a worker QThread of a data processing service
+     * \param target the object the values are written to
+     * \param source the source of the readings
+     * \param property the property to write. If empty, the default properties are searched
+     * \return a *new* instance of an object implementing CuMagicI
+     *
+     * The magic is moved to the thread of the target and properties are set in that thread, so that each
+     * worker thread applies the data of its own targets. The target does not own the magic, but the magic is
+     * deleted when the target is destroyed. Headless magics neither disable nor set tooltips on their targets,
+     * and are not subject to setUpdateBudget.
+     *
+     * The reader, the polling period and the error backoff stay in the thread that creates the magic, which
+     * must be the thread of the CumbiaPool. Data received there is queued to the thread of the target and
+     * applied in batches, so that the reader thread only copies the data.
+     *
+     * \note Call the methods of the magic from the thread that created it, and configure it (mapProperty, map,
+     *       setTransform...) before the worker thread starts receiving data
+     */
+    virtual CuMagicI *new_magic_headless(QObject* target, const QString& source = QString(), const QString& property = QString()) const = 0;
+
+    /*!
+     * \brief setUpdateBudget limit the time spent applying updates in each cycle of the event loop
+     * \param us the budget in microseconds. 0: no budget, each update is applied as soon as it arrives,
+     *        regardless of priority (default)
+     *
+     * With a budget, the updates of the magics created with new_magic are applied in order of priority:
+     * visible widgets first, then widgets in the active window and those with focus. A target can raise or
+     * lower its priority with the *cumagic_priority* dynamic property:
+     *
+     * \code
+       ui->statusLed->setProperty("cumagic_priority", -2);
+     * \endcode
+     *
+     * Updates that do not fit into the budget are postponed to the next cycle. A postponed magic receives
+     * only its newest value.
+     */
+    virtual void setUpdateBudget(int us) = 0;
+
+    /*!
+     * \brief updateBudget returns the time budget set with setUpdateBudget, in microseconds
+     */
+    virtual int updateBudget() const = 0;
+
+    /*!
+     * \brief setLazyConnect set lazy connection on the magics created from now on with new_magic
+     *
+     * See CuMagicI::setLazyConnect
+     */
+    virtual void setLazyConnect(bool lazy, int disconnectAfterMs = 0) = 0;
+
+    /*!
+     * \brief registerSynthEngine serve *synth://* sources with an in-process data generator
+     *
+     * After this call, the magics created by the plugin can read synthetic sources, without a control
+     * system, for example to measure throughput and latency:
+     *
+     * \code
+       plugin_i->registerSynthEngine();
+       plugin_i->new_magic(ui->plot, "synth://sine/double_spectrum?n=100000&hz=50", "yData");
+       plugin_i->new_magic(ui->progressBar, "synth://ramp/short_scalar?amp=100&err=0.01");
+     * \endcode
+     *
+     * Source form: *synth://shape/type_format?query*, with shape one of sine, ramp, random, const; type one of
+     * short, ushort, int, uint, long, ulong, longlong, ulonglong, float, double, longdouble, boolean, string,
+     * char, uchar; format one of scalar, spectrum, image. Query items: *n* (spectrum size), *rows* and *cols*
+     * (image size), *hz* (updates per second), *amp* (amplitude), *err* (fraction of error updates).
+     * The first update of each source carries its configuration (min, max, format, display unit).
+     * The engine is registered once and is owned by the plugin: further calls have no effect.
+     *
+     * \note Do not delete the engine registered as "synth" in the CumbiaPool, e.g. when the engines are
+     *       deleted before the application exits: the plugin unregisters and deletes it when destroyed
+     */
+    virtual void registerSynthEngine() = 0;
+
+    /*!
+     * \brief latencySources the sources of the magics created by the plugin that have recorded latencies
+     */
+    virtual QStringList latencySources() const = 0;
+
+    /*!
+     * \brief latencyPercentile as CuMagicI::latencyPercentile, over all the magics reading source
+     * \param stage a CuMagicI::LatencyStage
+     */
+    virtual double latencyPercentile(const QString& source, int stage, double p) const = 0;
+
+    /*!
+     * \brief latencyHistogram as CuMagicI::latencyHistogram, over all the magics reading source
+     */
+    virtual QVector<quint64> latencyHistogram(const QString& source, int stage) const = 0;
+
+    /*!
+     * \brief resetLatency clear the latency histograms of all sources (not those of each magic)
+     */
+    virtual void resetLatency() = 0;
+
+    /*!
+     * \brief startRecording record every CuData received by the magics into a memory mapped capture file
+     * \param path the capture file, created or truncated
+     * \param maxBytes the size of the mapping: recording stops when it is full
+     * \return false if the file cannot be mapped or a recording or replay is in progress
+     *
+     * Replay the capture with startReplay to reproduce the exact update stream offline
+     */
+    virtual bool startRecording(const QString& path, qint64 maxBytes = 256 << 20) = 0;
+
+    /*!
+     * \brief stopRecording stop recording and truncate the capture file to the size used
+     */
+    virtual void stopRecording() = 0;
+
+    /*!
+     * \brief startReplay deliver the data recorded in a capture to the magics with the same sources
+     * \param path a capture file written by startRecording
+     * \param speed 1: original timing, values greater than one replay faster, 0: as fast as possible
+     * \return false if the file is not a capture or a recording or replay is in progress
+     *
+     * Magics match the recorded data by the source given to setSource: no control system is needed.
+     * The *replayFinished* signal of the plugin object (see get_qobject) is emitted at the end of the capture
+     */
+    virtual bool startReplay(const QString& path, double speed = 1.0) = 0;
+
+    /*!
+     * \brief stopReplay stop a replay in progress
+     */
+    virtual void stopReplay() = 0;
+
+    /*!
+     * \brief startShmExport publish the latest value applied by each magic into a POSIX shared memory segment
+     * \param name the segment name, e.g. "/cumagic"
+     * \param nslots the maximum number of sources published
+     * \param slotSize the bytes reserved to each source, header included: larger values are flagged and skipped
+     * \return false if the segment cannot be created or an export is in progress
+     *
+     * Local processes (loggers, secondary displays) map the segment read only and read the latest values
+     * with no system calls and no further control system subscriptions. Each source has a fixed slot holding
+     * its value as a typed contiguous array, protected by a sequence lock. The layout and a reader are
+     * described in CuMagicShm.
+     */
+    virtual bool startShmExport(const QString& name, int nslots = 256, int slotSize = 16384) = 0;
+
+    /*!
+     * \brief stopShmExport stop publishing and unlink the segment
+     */
+    virtual void stopShmExport() = 0;
+
     // convenience method to get the plugin instance
 
     /*!
@@ -368,7 +854,7 @@ public:
     static QString file_name() { return "libcumbia-magic-plugin.so"; }
 };
 
-#define CuMagicPluginInterface_iid "eu.elettra.qutils.CuMagicPluginInterface"
+#define CuMagicPluginInterface_iid "eu.elettra.qutils.CuMagicPluginInterface/1.1"
 
 Q_DECLARE_INTERFACE(CuMagicPluginInterface, CuMagicPluginInterface_iid)
 
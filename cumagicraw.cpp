@@ -0,0 +1,143 @@
+#include "cumagicraw.h"
+#include <cumatrix.h>
+#include <vector>
+
+// matrix values store a CuMatrix<T>, whose elements are contiguous, row by row
+template <typename T> static const void *m_mx_data(const CuVariant& v, size_t *nr, size_t *nc) {
+    const CuMatrix<T> *m = v.toMatrixPtr<T>();
+    if(!m || m->nrows() == 0 || m->ncols() == 0)
+        return nullptr;
+    if(nr) *nr = m->nrows();
+    if(nc) *nc = m->ncols();
+    return (*m)[0];
+}
+
+template <typename T> static CuVariant m_variant(int fmt, const void *p, size_t nr, size_t nc) {
+    const T *t = static_cast<const T *>(p);
+    if(fmt == CuVariant::Scalar)
+        return CuVariant(*t);
+    std::vector<T> v(t, t + nr * nc);
+    if(fmt == CuVariant::Matrix)
+        return CuVariant(v, nr, nc);
+    return CuVariant(v);
+}
+
+template <typename T> static CuVariant m_from_doubles(int fmt, const std::vector<double>& d, size_t nr, size_t nc) {
+    std::vector<T> v(d.size());
+    for(size_t i = 0; i < d.size(); i++)
+        v[i] = static_cast<T>(d[i]);
+    if(fmt == CuVariant::Scalar)
+        return CuVariant(v[0]);
+    if(fmt == CuVariant::Matrix)
+        return CuVariant(v, nr, nc);
+    return CuVariant(v);
+}
+
+/*!
+ * \brief the size of one element of data type dt, 0 for strings and non numeric types
+ */
+size_t CuMagicRaw::elem_size(int dt) {
+    switch(dt) {
+    case CuVariant::Short: return sizeof(short);
+    case CuVariant::UShort: return sizeof(unsigned short);
+    case CuVariant::Int: return sizeof(int);
+    case CuVariant::UInt: return sizeof(unsigned int);
+    case CuVariant::LongInt: return sizeof(long int);
+    case CuVariant::LongUInt: return sizeof(unsigned long int);
+    case CuVariant::LongLongInt: return sizeof(long long int);
+    case CuVariant::LongLongUInt: return sizeof(unsigned long long int);
+    case CuVariant::Float: return sizeof(float);
+    case CuVariant::Double: return sizeof(double);
+    case CuVariant::LongDouble: return sizeof(long double);
+    case CuVariant::Boolean: return sizeof(bool);
+    case CuVariant::Char: return sizeof(char);
+    case CuVariant::UChar: return sizeof(unsigned char);
+    default: return 0;
+    }
+}
+
+/*!
+ * \brief the address of the first element of v
+ * \param v a numeric scalar, vector or matrix
+ * \param nrows if not null, receives the number of rows: 1 for scalars and vectors
+ * \param ncols if not null, receives the number of columns: the number of elements for scalars and vectors
+ * \return the address of nrows x ncols contiguous elements of size elem_size(v.getType()), nullptr if v is
+ *         not numeric or empty
+ */
+const void *CuMagicRaw::data(const CuVariant &v, size_t *nrows, size_t *ncols) {
+    if(elem_size(v.getType()) == 0 || v.getSize() == 0)
+        return nullptr;
+    if(v.getFormat() != CuVariant::Matrix) {
+        if(nrows) *nrows = 1;
+        if(ncols) *ncols = v.getSize();
+        return v.data();
+    }
+    const int dt = v.getType();
+    switch(dt) {
+    case CuVariant::Short: return m_mx_data<short>(v, nrows, ncols);
+    case CuVariant::UShort: return m_mx_data<unsigned short>(v, nrows, ncols);
+    case CuVariant::Int: return m_mx_data<int>(v, nrows, ncols);
+    case CuVariant::UInt: return m_mx_data<unsigned int>(v, nrows, ncols);
+    case CuVariant::LongInt: return m_mx_data<long int>(v, nrows, ncols);
+    case CuVariant::LongUInt: return m_mx_data<unsigned long int>(v, nrows, ncols);
+    case CuVariant::LongLongInt: return m_mx_data<long long int>(v, nrows, ncols);
+    case CuVariant::LongLongUInt: return m_mx_data<unsigned long long int>(v, nrows, ncols);
+    case CuVariant::Float: return m_mx_data<float>(v, nrows, ncols);
+    case CuVariant::Double: return m_mx_data<double>(v, nrows, ncols);
+    case CuVariant::LongDouble: return m_mx_data<long double>(v, nrows, ncols);
+    case CuVariant::Boolean: return m_mx_data<bool>(v, nrows, ncols);
+    case CuVariant::Char: return m_mx_data<char>(v, nrows, ncols);
+    case CuVariant::UChar: return m_mx_data<unsigned char>(v, nrows, ncols);
+    default: return nullptr;
+    }
+}
+
+/*!
+ * \brief a new CuVariant of type dt and format fmt with a copy of nrows x ncols elements at p
+ */
+CuVariant CuMagicRaw::variant(int dt, int fmt, const void *p, size_t nrows, size_t ncols) {
+    if(!p || nrows * ncols == 0)
+        return CuVariant();
+    switch(dt) {
+    case CuVariant::Short: return m_variant<short>(fmt, p, nrows, ncols);
+    case CuVariant::UShort: return m_variant<unsigned short>(fmt, p, nrows, ncols);
+    case CuVariant::Int: return m_variant<int>(fmt, p, nrows, ncols);
+    case CuVariant::UInt: return m_variant<unsigned int>(fmt, p, nrows, ncols);
+    case CuVariant::LongInt: return m_variant<long int>(fmt, p, nrows, ncols);
+    case CuVariant::LongUInt: return m_variant<unsigned long int>(fmt, p, nrows, ncols);
+    case CuVariant::LongLongInt: return m_variant<long long int>(fmt, p, nrows, ncols);
+    case CuVariant::LongLongUInt: return m_variant<unsigned long long int>(fmt, p, nrows, ncols);
+    case CuVariant::Float: return m_variant<float>(fmt, p, nrows, ncols);
+    case CuVariant::Double: return m_variant<double>(fmt, p, nrows, ncols);
+    case CuVariant::LongDouble: return m_variant<long double>(fmt, p, nrows, ncols);
+    case CuVariant::Boolean: return m_variant<bool>(fmt, p, nrows, ncols);
+    case CuVariant::Char: return m_variant<char>(fmt, p, nrows, ncols);
+    case CuVariant::UChar: return m_variant<unsigned char>(fmt, p, nrows, ncols);
+    default: return CuVariant();
+    }
+}
+
+/*!
+ * \brief a new CuVariant of type dt and format fmt with the nrows x ncols values converted to the type
+ */
+CuVariant CuMagicRaw::variant(int dt, int fmt, const std::vector<double> &values, size_t nrows, size_t ncols) {
+    if(values.size() == 0 || values.size() < nrows * ncols)
+        return CuVariant();
+    switch(dt) {
+    case CuVariant::Short: return m_from_doubles<short>(fmt, values, nrows, ncols);
+    case CuVariant::UShort: return m_from_doubles<unsigned short>(fmt, values, nrows, ncols);
+    case CuVariant::Int: return m_from_doubles<int>(fmt, values, nrows, ncols);
+    case CuVariant::UInt: return m_from_doubles<unsigned int>(fmt, values, nrows, ncols);
+    case CuVariant::LongInt: return m_from_doubles<long int>(fmt, values, nrows, ncols);
+    case CuVariant::LongUInt: return m_from_doubles<unsigned long int>(fmt, values, nrows, ncols);
+    case CuVariant::LongLongInt: return m_from_doubles<long long int>(fmt, values, nrows, ncols);
+    case CuVariant::LongLongUInt: return m_from_doubles<unsigned long long int>(fmt, values, nrows, ncols);
+    case CuVariant::Float: return m_from_doubles<float>(fmt, values, nrows, ncols);
+    case CuVariant::Double: return m_from_doubles<double>(fmt, values, nrows, ncols);
+    case CuVariant::LongDouble: return m_from_doubles<long double>(fmt, values, nrows, ncols);
+    case CuVariant::Boolean: return m_from_doubles<bool>(fmt, values, nrows, ncols);
+    case CuVariant::Char: return m_from_doubles<char>(fmt, values, nrows, ncols);
+    case CuVariant::UChar: return m_from_doubles<unsigned char>(fmt, values, nrows, ncols);
+    default: return CuVariant();
+    }
+}
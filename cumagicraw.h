@@ -0,0 +1,25 @@
+#ifndef CUMAGICRAW_H
+#define CUMAGICRAW_H
+
+#include <cstddef>
+#include <vector>
+#include <cuvariant.h>
+
+/*!
+ * \brief CuMagicRaw gives access to the contiguous storage of numeric CuVariant values and builds
+ *        CuVariant values from raw storage, without intermediate conversions
+ *
+ * Used to write values to capture files and shared memory as they are, and to read them back.
+ * Strings (CuVariant::String) and void pointers have no raw storage: data returns nullptr and
+ * elem_size 0.
+ */
+class CuMagicRaw
+{
+public:
+    static size_t elem_size(int dt);
+    static const void *data(const CuVariant& v, size_t *nrows = nullptr, size_t *ncols = nullptr);
+    static CuVariant variant(int dt, int fmt, const void *p, size_t nrows, size_t ncols);
+    static CuVariant variant(int dt, int fmt, const std::vector<double>& values, size_t nrows, size_t ncols);
+};
+
+#endif // CUMAGICRAW_H
@@ -0,0 +1,96 @@
+#include "cumagicscheduler.h"
+#include "cumagic.h"
+#include <QTimer>
+#include <QVector>
+#include <QPair>
+#include <algorithm>
+
+CuMagicScheduler::CuMagicScheduler(QObject *parent) : QObject(parent) {
+    m_budget_us = 0;
+    m_timer = new QTimer(this);
+    m_timer->setSingleShot(true);
+    m_timer->setInterval(0);
+    connect(m_timer, SIGNAL(timeout()), this, SLOT(run()));
+}
+
+CuMagicScheduler::~CuMagicScheduler() {
+}
+
+/*!
+ * \brief set the time budget to apply updates in one event loop cycle
+ * \param us microseconds. 0: no budget (default). The magics do not use the scheduler and apply their
+ *        updates as they arrive. Updates still pending are applied in the next cycle
+ *
+ * The budget is checked after each update, so the highest priority update is always applied
+ */
+void CuMagicScheduler::setBudget(int us) {
+    m_budget_us = std::max(us, 0);
+    if(m_budget_us == 0 && !m_pending.isEmpty())
+        run();
+}
+
+int CuMagicScheduler::budget() const {
+    return m_budget_us;
+}
+
+/*!
+ * \brief apply the data on m in the next cycle
+ *
+ * Configuration replaces the configuration not applied yet. A value replaces the value not applied yet
+ * if both are errors or both are valid, otherwise both are kept, so that the transition is applied.
+ *
+ * CuMagic bypasses the scheduler when there is no budget. Data scheduled anyway is applied in the
+ * next cycle, all of it: a zero budget is unlimited
+ */
+void CuMagicScheduler::schedule(CuMagic *m, const CuData &da) {
+    Pending &p = m_pending[m];
+    if(da[CuDType::Type].toString() == "property") {  // da["type"]
+        p.conf = da;
+        p.has_conf = true;
+    }
+    else if(!p.values.isEmpty() && p.values.last()[CuDType::Err].toBool() == da[CuDType::Err].toBool())  // da["err"]
+        p.values.last() = da;
+    else {
+        p.values.append(da);
+        if(p.values.size() > 2) // the last transition is enough
+            p.values.removeFirst();
+    }
+    if(!m_timer->isActive())
+        m_timer->start();
+}
+
+/*!
+ * \brief forget pending data for m, e.g. because m is being destroyed
+ */
+void CuMagicScheduler::remove(CuMagic *m) {
+    m_pending.remove(m);
+}
+
+void CuMagicScheduler::run() {
+    QElapsedTimer t;
+    t.start();
+    // (priority, magic), highest first
+    QVector<QPair<int, CuMagic *> > q;
+    q.reserve(m_pending.size());
+    for(QHash<CuMagic *, Pending>::const_iterator it = m_pending.constBegin(); it != m_pending.constEnd(); ++it)
+        q.append(qMakePair(it.key()->priority() + it.value().waited, it.key()));
+    std::stable_sort(q.begin(), q.end(), [](const QPair<int, CuMagic *>& a, const QPair<int, CuMagic *>& b) { return a.first > b.first; });
+    const qint64 budget_ns = static_cast<qint64>(m_budget_us) * 1000;
+    int i = 0;
+    for(; i < q.size() && (i == 0 || m_budget_us == 0 || t.nsecsElapsed() < budget_ns); i++) {
+        CuMagic *m = q[i].second;
+        QHash<CuMagic *, Pending>::iterator it = m_pending.find(m);
+        if(it == m_pending.end())
+            continue; // removed while applying a previous update
+        const Pending p = it.value();
+        m_pending.erase(it);
+        if(p.has_conf)
+            m->m_apply(p.conf);
+        foreach(const CuData& da, p.values)
+            m->m_apply(da);
+    }
+    for(QHash<CuMagic *, Pending>::iterator it = m_pending.begin(); it != m_pending.end(); ++it)
+        it->waited++;
+    if(!m_pending.isEmpty())
+        m_timer->start();
+}
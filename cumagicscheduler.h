@@ -0,0 +1,62 @@
+#ifndef CUMAGICSCHEDULER_H
+#define CUMAGICSCHEDULER_H
+
+#include <QObject>
+#include <QHash>
+#include <QElapsedTimer>
+#include <QList>
+#include <cudata.h>
+
+class CuMagic;
+class QTimer;
+
+/*!
+ * \brief CuMagicScheduler applies the updates of all the CuMagic objects created by the plugin in order of
+ *        priority, within a time budget per event loop cycle
+ *
+ * Each CuMagic hands its data over with schedule. Only the newest value of each magic is kept, so a magic
+ * whose updates are postponed receives its latest value only. The newest configuration ("property" data)
+ * is kept apart and applied first, and a change between error and valid data is not coalesced away. When the budget is exhausted, the remaining
+ * updates are applied in the next cycle. Postponed magics gain priority with each cycle they wait, so that
+ * they are not starved.
+ *
+ * A zero budget (default) means no budget: the magics bypass the scheduler and apply their updates as
+ * soon as they arrive, regardless of priority.
+ *
+ * Priorities are cached by CuMagic and computed again when the target is shown or hidden, its window is
+ * activated or deactivated, the focus moves or a dynamic property of the target changes.
+ *
+ * \see CuMagic::priority
+ */
+class CuMagicScheduler : public QObject
+{
+    Q_OBJECT
+public:
+    CuMagicScheduler(QObject *parent);
+    ~CuMagicScheduler();
+
+    void setBudget(int us);
+    int budget() const;
+
+    void schedule(CuMagic *m, const CuData& da);
+    void remove(CuMagic *m);
+
+private slots:
+    void run();
+
+private:
+    class Pending {
+    public:
+        Pending() : has_conf(false), waited(0) {}
+        CuData conf; // latest configuration, if has_conf
+        bool has_conf;
+        QList<CuData> values; // latest value, preceded by the last one with the other error state, if any
+        int waited; // cycles waited
+    };
+
+    QHash<CuMagic *, Pending> m_pending;
+    QTimer *m_timer;
+    int m_budget_us;
+};
+
+#endif // CUMAGICSCHEDULER_H
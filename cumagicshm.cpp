@@ -0,0 +1,201 @@
+#include "cumagicshm.h"
+#include "cumagicraw.h"
+#include <cudata.h>
+#include <cumacros.h>
+#include <QMutexLocker>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+
+static const char shm_magic[8] = { 'C', 'U', 'M', 'A', 'G', 'S', 'H', 'M' };
+
+CuMagicShm::CuMagicShm() {
+    m_map = nullptr;
+    m_siz = 0;
+}
+
+CuMagicShm::~CuMagicShm() {
+    stop();
+}
+
+/*!
+ * \brief create (or replace) the shared memory segment name and publish into it from now on
+ * \param name the POSIX name of the segment, e.g. "/cumagic". A leading slash is added if missing
+ * \param nslots the maximum number of sources
+ * \param slotSize bytes per slot, header included, rounded up to a multiple of 8
+ * \return false if already started or the segment cannot be created and mapped
+ */
+bool CuMagicShm::start(const QString &name, int nslots, int slotSize) {
+    QMutexLocker lo(&m_mu);
+    const size_t ssiz = (static_cast<size_t>(qMax(slotSize, 0)) + 7) & ~static_cast<size_t>(7);
+    if(m_map || nslots <= 0 || ssiz <= sizeof(SlotHeader)) {
+        perr("CuMagicShm.start: already started or invalid slots %d / slot size %d (min %zu)", nslots, slotSize, sizeof(SlotHeader) + 8);
+        return false;
+    }
+    const QByteArray& n = (name.startsWith('/') ? name : "/" + name).toLocal8Bit();
+    const size_t siz = sizeof(Header) + nslots * ssiz;
+    int fd = shm_open(n.data(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0 || ftruncate(fd, siz) < 0) {
+        perr("CuMagicShm.start: failed to create shared memory \"%s\" with size %zu: %s", n.data(), siz, strerror(errno));
+        if(fd > -1) {
+            close(fd);
+            shm_unlink(n.data());
+        }
+        return false;
+    }
+    void *p = mmap(nullptr, siz, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd); // the mapping stays valid
+    if(p == MAP_FAILED) {
+        perr("CuMagicShm.start: failed to map \"%s\": %s", n.data(), strerror(errno));
+        shm_unlink(n.data());
+        return false;
+    }
+    m_map = static_cast<char *>(p);
+    m_siz = siz;
+    m_name = name.startsWith('/') ? name : "/" + name;
+    memset(m_map, 0, siz); // all slots unused
+    Header *h = reinterpret_cast<Header *>(m_map);
+    h->version = Version;
+    h->n_slots = nslots;
+    h->slot_size = ssiz;
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(h->magic, shm_magic, sizeof(shm_magic)); // valid from now on
+    m_slots.clear();
+    return true;
+}
+
+/*!
+ * \brief unmap and unlink the segment. Readers that have it mapped keep the last values
+ */
+void CuMagicShm::stop() {
+    QMutexLocker lo(&m_mu);
+    if(!m_map)
+        return;
+    munmap(m_map, m_siz);
+    shm_unlink(m_name.toLocal8Bit().data());
+    m_map = nullptr;
+    m_siz = 0;
+    m_slots.clear();
+}
+
+bool CuMagicShm::active() const {
+    return m_map != nullptr;
+}
+
+CuMagicShm::SlotHeader *CuMagicShm::m_slot(int i) const {
+    const Header *h = reinterpret_cast<const Header *>(m_map);
+    return reinterpret_cast<SlotHeader *>(m_map + sizeof(Header) + static_cast<size_t>(i) * h->slot_size);
+}
+
+/*!
+ * \brief write the value in da, read from src, into the slot of src
+ *
+ * The first value of a source takes the next free slot. If all slots are taken, the value is not published
+ */
+void CuMagicShm::publish(const QString &src, const CuData &da) {
+    QMutexLocker lo(&m_mu);
+    if(!m_map)
+        return;
+    Header *hdr = reinterpret_cast<Header *>(m_map);
+    QHash<QString, int>::const_iterator it = m_slots.constFind(src);
+    int i = it != m_slots.constEnd() ? it.value() : static_cast<int>(hdr->n_used);
+    if(it == m_slots.constEnd()) { // new source: next free slot, -1 if none
+        if(i >= static_cast<int>(hdr->n_slots)) {
+            perr("CuMagicShm.publish: all %u slots taken: \"%s\" not published", hdr->n_slots, qstoc(src));
+            i = -1;
+        }
+        m_slots.insert(src, i);
+    }
+    if(i < 0)
+        return;
+
+    const CuVariant &v = da[CuDType::Value];  // da["value"]
+    size_t nr = 0, nc = 0, dlen = 0;
+    const void *raw = v.isValid() ? CuMagicRaw::data(v, &nr, &nc) : nullptr;
+    std::vector<std::string> sv;
+    if(raw)
+        dlen = nr * nc * CuMagicRaw::elem_size(v.getType());
+    else if(v.isValid() && v.getType() == CuVariant::String) {
+        sv = v.toStringVector();
+        nr = 1;
+        nc = sv.size();
+        for(size_t j = 0; j < sv.size(); j++)
+            dlen += sv[j].size() + 1;
+    }
+    const bool fits = sizeof(SlotHeader) + dlen <= hdr->slot_size;
+
+    SlotHeader *s = m_slot(i);
+    const quint32 seq = __atomic_load_n(&s->seq, __ATOMIC_RELAXED);
+    __atomic_store_n(&s->seq, seq + 1, __ATOMIC_RELAXED); // odd: writing
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    if(seq == 0) { // first use of the slot
+        const QByteArray& name = src.toUtf8();
+        const int len = qMin(name.size(), static_cast<int>(SrcLen) - 1);
+        memcpy(s->src, name.constData(), len);
+        s->src[len] = '\0';
+    }
+    s->flags = (da[CuDType::Err].toBool() ? FErr : 0) | (fits ? 0 : FTooLarge);  // da["err"]
+    s->ts_ms = 0;
+    if(da.containsKey(CuDType::Time_ms))  // da.containsKey("timestamp_ms")
+        da[CuDType::Time_ms].to<qint64>(s->ts_ms);
+    s->type = v.getType();
+    s->format = v.getFormat();
+    s->nrows = nr;
+    s->ncols = nc;
+    s->data_len = fits ? dlen : 0;
+    char *p = reinterpret_cast<char *>(s) + sizeof(SlotHeader);
+    if(fits && raw)
+        memcpy(p, raw, dlen);
+    else if(fits)
+        for(size_t j = 0; j < sv.size(); j++) {
+            memcpy(p, sv[j].c_str(), sv[j].size() + 1);
+            p += sv[j].size() + 1;
+        }
+    __atomic_store_n(&s->seq, seq + 2, __ATOMIC_RELEASE); // even: consistent
+    if(seq == 0)
+        __atomic_store_n(&hdr->n_used, static_cast<quint32>(i + 1), __ATOMIC_RELEASE);
+}
+
+/*!
+ * \brief read a consistent copy of a slot from a mapped segment, without locks
+ * \param map the address of the segment, mapped read only by the reader
+ * \param slot the slot index, less than Header::n_used
+ * \param h receives the slot header
+ * \param data receives the value, if not null. At most datasiz bytes are copied
+ * \return false if the segment is not valid, the slot is not used or h->data_len exceeds datasiz
+ *
+ * \par Example
+ * \code
+   int fd = shm_open("/cumagic", O_RDONLY, 0);
+   struct stat st;
+   fstat(fd, &st);
+   const void *map = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+   CuMagicShm::SlotHeader h;
+   std::vector<double> v(4096);
+   if(CuMagicShm::read(map, 0, &h, v.data(), v.size() * sizeof(double)) && h.type == CuVariant::Double)
+       printf("%s: %u values, first %f\n", h.src, h.ncols, v[0]);
+ * \endcode
+ */
+bool CuMagicShm::read(const void *map, int slot, SlotHeader *h, void *data, size_t datasiz) {
+    const Header *hdr = static_cast<const Header *>(map);
+    if(memcmp(hdr->magic, shm_magic, sizeof(shm_magic)) != 0 || slot < 0
+            || slot >= static_cast<int>(__atomic_load_n(&hdr->n_used, __ATOMIC_ACQUIRE)))
+        return false;
+    const char *sp = static_cast<const char *>(map) + sizeof(Header) + static_cast<size_t>(slot) * hdr->slot_size;
+    const SlotHeader *s = reinterpret_cast<const SlotHeader *>(sp);
+    quint32 seq0, seq1;
+    do {
+        seq0 = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+        if(seq0 & 1)
+            continue; // being written
+        memcpy(h, s, sizeof(SlotHeader));
+        if(data && h->data_len <= datasiz && h->data_len <= hdr->slot_size - sizeof(SlotHeader))
+            memcpy(data, sp + sizeof(SlotHeader), h->data_len);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        seq1 = __atomic_load_n(&s->seq, __ATOMIC_RELAXED);
+    } while((seq0 & 1) || seq0 != seq1);
+    return seq0 != 0 && (!data || h->data_len <= datasiz);
+}
@@ -0,0 +1,79 @@
+#ifndef CUMAGICSHM_H
+#define CUMAGICSHM_H
+
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <QtGlobal>
+
+class CuData;
+
+/*!
+ * \brief CuMagicShm publishes the latest value applied by the magics into a named POSIX shared memory
+ *        segment, so that local processes read it without subscribing to the control system again
+ *
+ * \par Segment layout
+ * A CuMagicShm::Header followed by n_slots slots of *slot_size* bytes each. Each source is given a slot
+ * the first time one of its values is published, in order, and keeps it until stop. A slot starts with a
+ * CuMagicShm::SlotHeader and is followed by the value, copied as is from the storage of the CuVariant:
+ * a contiguous array of nrows x ncols elements of the type *type* (a CuVariant::DataType), row major.
+ * Strings are stored as a sequence of nul terminated strings. Byte order and type sizes are those of the
+ * host. Values that do not fit into a slot are published with the FTooLarge flag and no data.
+ *
+ * \par Seqlock
+ * The *seq* field of a slot is odd while the slot is being written and is incremented twice per update.
+ * Readers need no lock and no system call: read *seq* (acquire), retry while odd, copy the slot, then
+ * read *seq* again (after an acquire fence) and retry if it changed. See CuMagicShm::read. A slot whose
+ * seq is zero is not used yet. Header::n_used counts the slots in use.
+ *
+ * Writers are serialized by a mutex, so headless magics may publish from different threads.
+ */
+class CuMagicShm
+{
+public:
+    enum { Version = 1, SrcLen = 256 };
+    enum Flags { FErr = 0x1, FTooLarge = 0x2 };
+
+    struct Header {
+        char magic[8]; // "CUMAGSHM"
+        quint32 version;
+        quint32 n_slots;
+        quint32 slot_size; // bytes per slot, including the SlotHeader
+        quint32 n_used; // slots assigned to a source
+        quint32 reserved[2];
+    };
+
+    struct SlotHeader {
+        quint32 seq; // odd while writing
+        quint32 flags; // Flags
+        char src[SrcLen]; // nul terminated
+        qint64 ts_ms; // data timestamp, 0 if missing
+        quint16 type; // CuVariant::DataType
+        quint8 format; // CuVariant::DataFormat
+        quint8 pad;
+        quint32 nrows, ncols;
+        quint32 data_len; // bytes following this struct
+        quint32 pad2;
+    };
+
+    CuMagicShm();
+    ~CuMagicShm();
+
+    bool start(const QString& name, int nslots, int slotSize);
+    void stop();
+    bool active() const;
+    void publish(const QString& src, const CuData& da);
+
+    static bool read(const void *map, int slot, SlotHeader *h, void *data, size_t datasiz);
+
+private:
+    SlotHeader *m_slot(int i) const;
+
+    QMutex m_mu;
+    QString m_name;
+    char *m_map;
+    size_t m_siz;
+    QHash<QString, int> m_slots;
+};
+
+#endif // CUMAGICSHM_H
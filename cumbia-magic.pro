@@ -111,11 +111,28 @@ TARGET = cumbia-magic-plugin
 TEMPLATE = lib
 CONFIG += plugin debug
 
+# shm_open, shm_unlink (CuMagicShm)
+unix:LIBS += -lrt
+
 SOURCES += \
-    cumagic.cpp
+    cumagic.cpp \
+    cumagicagg.cpp \
+    cumagicscheduler.cpp \
+    cumagiccapture.cpp \
+    cumagicraw.cpp \
+    cumbiasynth.cpp \
+    cumagichistogram.cpp \
+    cumagicshm.cpp
 
 HEADERS += \
-    cumagic.h
+    cumagic.h \
+    cumagicagg.h \
+    cumagicscheduler.h \
+    cumagiccapture.h \
+    cumagicraw.h \
+    cumbiasynth.h \
+    cumagichistogram.h \
+    cumagicshm.h
 
 DISTFILES += cumbia-magic.json  \
     cumagicplugininterface.h \
@@ -0,0 +1,234 @@
+#include "cumbiasynth.h"
+#include "cumagicraw.h"
+#include <cumbiapool.h>
+#include <cucontrolsfactorypool.h>
+#include <cumacros.h>
+#include <QTimer>
+#include <QUrl>
+#include <QUrlQuery>
+#include <QDateTime>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+#include <string>
+
+CumbiaSynth::CumbiaSynth() : Cumbia() {
+}
+
+int CumbiaSynth::getType() const {
+    return CumbiaSynthType;
+}
+
+/*!
+ * \brief register the synthetic engine for the *synth://* sources into cu_pool and fpoo
+ * \return the new engine, owned by the caller, that must unregister it from cu_pool before deleting it.
+ *         nullptr if an engine named *synth* is already registered in cu_pool
+ *
+ * \note CuMagicPluginInterface::registerSynthEngine registers the engine used by the magics
+ */
+CumbiaSynth *CumbiaSynth::registerInto(CumbiaPool *cu_pool, CuControlsFactoryPool &fpoo) {
+    if(cu_pool->get("synth"))
+        return nullptr;
+    std::vector<std::string> patterns { "synth://.+" };
+    CumbiaSynth *cs = new CumbiaSynth();
+    cu_pool->registerCumbiaImpl("synth", cs);
+    cu_pool->setSrcPatterns("synth", patterns);
+    fpoo.registerImpl("synth", CuSynthReaderFactory());
+    fpoo.setSrcPatterns("synth", patterns);
+    return cs;
+}
+
+class CuSynthReaderPrivate {
+public:
+    QString src;
+    CuData options;
+    QTimer *timer;
+    QString shape;
+    int dt, fmt;
+    size_t nrows, ncols;
+    double amp, err;
+    int per_tick; // updates per timer tick, for rates above 1kHz
+    unsigned long long k; // update counter
+    double err_acc; // error accumulator, see m_update
+};
+
+CuSynthReader::CuSynthReader(Cumbia *c, CuDataListener *l) : QObject(nullptr), CuControlsReaderA(c, l) {
+    d = new CuSynthReaderPrivate;
+    d->timer = new QTimer(this);
+    d->dt = CuVariant::Double;
+    d->fmt = CuVariant::Scalar;
+    d->nrows = d->ncols = 1;
+    d->amp = 100.0;
+    d->err = d->err_acc = 0.0;
+    d->per_tick = 1;
+    d->k = 0;
+    connect(d->timer, SIGNAL(timeout()), this, SLOT(m_update()));
+}
+
+CuSynthReader::~CuSynthReader() {
+    delete d;
+}
+
+static int m_synth_type(const QString& t) {
+    static const struct { const char *name; int dt; } types[] = {
+        { "short", CuVariant::Short }, { "ushort", CuVariant::UShort }, { "int", CuVariant::Int },
+        { "uint", CuVariant::UInt }, { "long", CuVariant::LongInt }, { "ulong", CuVariant::LongUInt },
+        { "longlong", CuVariant::LongLongInt }, { "ulonglong", CuVariant::LongLongUInt },
+        { "float", CuVariant::Float }, { "double", CuVariant::Double }, { "longdouble", CuVariant::LongDouble },
+        { "boolean", CuVariant::Boolean }, { "bool", CuVariant::Boolean }, { "string", CuVariant::String },
+        { "char", CuVariant::Char }, { "uchar", CuVariant::UChar } };
+    for(size_t i = 0; i < sizeof(types) / sizeof(types[0]); i++)
+        if(t == types[i].name)
+            return types[i].dt;
+    return CuVariant::TypeInvalid;
+}
+
+void CuSynthReader::setSource(const QString &s) {
+    const QUrl u(s);
+    const QUrlQuery q(u);
+    const QString& tf = u.path().section('/', 1, 1);
+    d->src = s;
+    d->shape = u.host();
+    d->dt = m_synth_type(tf.section('_', 0, -2));
+    const QString& f = tf.section('_', -1);
+    d->fmt = f == "scalar" ? CuVariant::Scalar : (f == "spectrum" || f == "vector") ? CuVariant::Vector
+                                                : (f == "image" || f == "matrix") ? CuVariant::Matrix : CuVariant::FormatInvalid;
+    if(d->dt == CuVariant::TypeInvalid || d->fmt == CuVariant::FormatInvalid)
+        perr("CuSynthReader.setSource: invalid source \"%s\": expected synth://shape/type_format, e.g. synth://sine/double_spectrum", qstoc(s));
+    d->nrows = d->fmt == CuVariant::Matrix ? q.queryItemValue("rows").toUInt() : 1;
+    d->ncols = d->fmt == CuVariant::Matrix ? q.queryItemValue("cols").toUInt() : d->fmt == CuVariant::Vector ? q.queryItemValue("n").toUInt() : 1;
+    if(d->nrows == 0) d->nrows = 100;
+    if(d->ncols == 0) d->ncols = d->fmt == CuVariant::Matrix ? 100 : 1000;
+    d->amp = q.hasQueryItem("amp") ? q.queryItemValue("amp").toDouble() : 100.0;
+    d->err = q.queryItemValue("err").toDouble();
+    d->k = 0;
+    double hz = q.hasQueryItem("hz") ? q.queryItemValue("hz").toDouble() : 10.0;
+    if(d->options.containsKey("period")) {
+        int ms = 1000;
+        d->options["period"].to<int>(ms);
+        hz = 1000.0 / std::max(ms, 1);
+    }
+    m_set_rate(hz);
+    // configuration first, from the event loop: the listener is still within setSource
+    QMetaObject::invokeMethod(this, "m_configure", Qt::QueuedConnection);
+}
+
+void CuSynthReader::m_configure() {
+    if(!d->src.isEmpty())
+        getDataListener()->onUpdate(m_make(true));
+}
+
+QString CuSynthReader::source() const {
+    return d->src;
+}
+
+void CuSynthReader::unsetSource() {
+    d->timer->stop();
+    d->src.clear();
+}
+
+void CuSynthReader::setOptions(const CuData &o) {
+    d->options = o;
+}
+
+CuData CuSynthReader::getOptions() const {
+    return d->options;
+}
+
+/*!
+ * \brief accepts *period*, in milliseconds
+ */
+void CuSynthReader::sendData(const CuData &da) {
+    if(da.containsKey("period")) {
+        int ms = 1000;
+        da["period"].to<int>(ms);
+        m_set_rate(1000.0 / std::max(ms, 1));
+    }
+}
+
+void CuSynthReader::getData(CuData &d_ino) const {
+    d_ino.set("period", static_cast<int>(d->timer->interval()));
+}
+
+// QTimer resolution is 1ms: above 1kHz, more updates are delivered on each tick
+void CuSynthReader::m_set_rate(double hz) {
+    hz = std::max(hz, 0.001);
+    d->per_tick = std::max(1, static_cast<int>(std::ceil(hz / 1000.0)));
+    d->timer->start(std::max(1, static_cast<int>(1000.0 * d->per_tick / hz)));
+}
+
+void CuSynthReader::m_update() {
+    for(int i = 0; i < d->per_tick && !d->src.isEmpty(); i++)
+        getDataListener()->onUpdate(m_make(false));
+}
+
+/*
+ * the values for the update number d->k. Errors are spread evenly: one every 1 / err updates
+ */
+CuData CuSynthReader::m_make(bool property) {
+    CuData da(CuDType::Src, d->src.toStdString());  // CuData("src", ...)
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    da.set(CuDType::Time_ms, now);  // da["timestamp_ms"]
+    da.set(CuDType::Time_us, static_cast<double>(now) / 1000.0);  // da["timestamp_us"]: seconds, as the engines
+    d->err_acc += d->err;
+    if(!property && d->err_acc >= 1.0) {
+        d->err_acc -= 1.0;
+        d->k++;
+        da.set(CuDType::Err, true);  // da["err"]
+        da.set(CuDType::Message, std::string("synthetic error"));  // da["msg"]
+        return da;
+    }
+    const size_t n = d->nrows * d->ncols;
+    std::vector<double> v(n);
+    const double a = d->amp, ph = 0.1 * d->k;
+    if(d->shape == "sine")
+        for(size_t i = 0; i < n; i++)
+            v[i] = a * std::sin(2 * M_PI * (i % d->ncols) / d->ncols + ph + (i / d->ncols) * 0.05);
+    else if(d->shape == "ramp")
+        for(size_t i = 0; i < n; i++)
+            v[i] = static_cast<double>((d->k + i) % (static_cast<unsigned long long>(std::fabs(a)) + 1));
+    else if(d->shape == "random")
+        for(size_t i = 0; i < n; i++)
+            v[i] = a * (2.0 * rand() / RAND_MAX - 1.0);
+    else
+        std::fill(v.begin(), v.end(), a);
+    d->k++;
+    if(d->dt == CuVariant::String) {
+        std::vector<std::string> sv(n);
+        for(size_t i = 0; i < n; i++)
+            sv[i] = std::to_string(v[i]);
+        da.set(CuDType::Value, d->fmt == CuVariant::Scalar ? CuVariant(sv[0]) : d->fmt == CuVariant::Matrix  // da["value"]
+                ? CuVariant(sv, d->nrows, d->ncols) : CuVariant(sv));
+    }
+    else
+        da.set(CuDType::Value, CuMagicRaw::variant(d->dt, d->fmt, v, d->nrows, d->ncols));  // da["value"]
+    da.set(CuDType::Err, false);  // da["err"]
+    if(property) {
+        da.set(CuDType::Type, std::string("property"));  // da["type"]
+        da.set(CuDType::Min, d->shape == "ramp" ? 0.0 : -std::fabs(d->amp));  // da["min"]
+        da.set(CuDType::Max, std::fabs(d->amp));  // da["max"]
+        da.set(CuDType::NumberFormat, std::string("%.2f"));  // da["format"]
+        da.set("display_unit", std::string("au"));
+    }
+    return da;
+}
+
+CuControlsReaderA *CuSynthReaderFactory::create(Cumbia *c, CuDataListener *l) const {
+    CuSynthReader *r = new CuSynthReader(c, l);
+    r->setOptions(m_options);
+    return r;
+}
+
+CuControlsReaderFactoryI *CuSynthReaderFactory::clone() const {
+    CuSynthReaderFactory *f = new CuSynthReaderFactory();
+    f->m_options = m_options;
+    return f;
+}
+
+void CuSynthReaderFactory::setOptions(const CuData &o) {
+    m_options = o;
+}
+
+CuData CuSynthReaderFactory::getOptions() const {
+    return m_options;
+}
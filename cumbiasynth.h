@@ -0,0 +1,92 @@
+#ifndef CUMBIASYNTH_H
+#define CUMBIASYNTH_H
+
+#include <QObject>
+#include <QString>
+#include <cumbia.h>
+#include <cudata.h>
+#include <cucontrolsreader_abs.h>
+#include <cucontrolsreaderfactoryi.h>
+
+class QTimer;
+class CumbiaPool;
+class CuControlsFactoryPool;
+class CuSynthReaderPrivate;
+
+/*!
+ * \brief CumbiaSynth is an in-process engine that generates data, to measure and test CuMagic without a
+ *        control system
+ *
+ * Sources have the form
+ *
+ * \code
+ * synth://shape/type_format?n=1000&hz=10&err=0.01
+ * \endcode
+ *
+ * \li *shape*: sine, ramp, random or const
+ * \li *type*: short, ushort, int, uint, long, ulong, longlong, ulonglong, float, double, longdouble,
+ *     boolean, string, char, uchar (the names of CuVariant::DataType)
+ * \li *format*: scalar, spectrum (or vector), image (or matrix)
+ * \li *n*: number of elements of a spectrum (default 1000); *rows* and *cols* give the size of an image
+ *     (default 100 x 100)
+ * \li *hz*: updates per second (default 10). The *period* option and sendData(CuData("period", ms)) change it
+ * \li *amp*: amplitude of the values (default 100)
+ * \li *err*: fraction of updates delivered as errors (default 0)
+ *
+ * The first update of a source is a *property* packet, with min, max, format and display unit. It is
+ * delivered from the event loop, as the engines do, never from within setSource.
+ *
+ * \see registerInto
+ */
+class CumbiaSynth : public Cumbia
+{
+public:
+    enum Type { CumbiaSynthType = Cumbia::CumbiaUserType + 42 };
+
+    CumbiaSynth();
+    int getType() const;
+
+    static CumbiaSynth *registerInto(CumbiaPool *cu_pool, CuControlsFactoryPool &fpoo);
+};
+
+class CuSynthReader : public QObject, public CuControlsReaderA
+{
+    Q_OBJECT
+public:
+    CuSynthReader(Cumbia *c, CuDataListener *l);
+    ~CuSynthReader();
+
+    // CuControlsReaderA interface
+public:
+    void setSource(const QString &s);
+    QString source() const;
+    void unsetSource();
+    void setOptions(const CuData &o);
+    CuData getOptions() const;
+    void sendData(const CuData &d);
+    void getData(CuData &d_ino) const;
+
+private slots:
+    void m_update();
+    void m_configure();
+
+private:
+    CuSynthReaderPrivate *d;
+
+    void m_set_rate(double hz);
+    CuData m_make(bool property);
+};
+
+class CuSynthReaderFactory : public CuControlsReaderFactoryI
+{
+public:
+    CuControlsReaderA *create(Cumbia *c, CuDataListener *l) const;
+    CuControlsReaderFactoryI *clone() const;
+    void setOptions(const CuData &o);
+    CuData getOptions() const;
+
+private:
+    CuData m_options;
+};
+
+#endif // CUMBIASYNTH_H
@@ -11,38 +11,118 @@
 #include <cumagicplugininterface.h>
 #include <QtDebug>
 #include <QMetaProperty>
+#include <QApplication>
+#include <QPair>
+#include <algorithm>
 #include <quplotcurve.h>
 
 
-void MyDisplayMatrix::setMyData(const CuMatrix<double> &m) {
-    if(m != myData()) {
-        if(m.nrows() != (size_t) rowCount() || m.ncols() != (size_t) columnCount()) {
-            this->clear();
-            setRowCount(m.nrows());
-            setColumnCount(m.ncols());
-        }
-        for(size_t r = 0; r < m.nrows(); r++) {
-            for(size_t c = 0; c < m.ncols(); c++) {
-                QTableWidgetItem *i = item(r, c);
-                if(!i) {
-                    i = new QTableWidgetItem(QString::number(m[r][c]));
-                    setItem(r, c, i);
+/*
+ * returns the number of changed cells, -1 if the size changed
+ */
+int MyMatrixModel::setMatrix(const CuMatrix<double> &m) {
+    if(m.nrows() != m_m.nrows() || m.ncols() != m_m.ncols()) {
+        beginResetModel();
+        m_m = m;
+        endResetModel();
+        return -1;
+    }
+    const size_t nr = m.nrows(), nc = m.ncols();
+    int changed = 0;
+    QVector<QPair<QModelIndex, QModelIndex> > blocks; // signaled once m_m holds the new data
+    int r0 = -1; // first row of the current block of changed rows
+    size_t c0 = nc, c1 = 0; // changed columns in the block
+    for(size_t r = 0; r <= nr; r++) {
+        size_t rc0 = nc, rc1 = 0;
+        if(r < nr) {
+            const double *a = m[r], *b = m_m[r];
+            for(size_t c = 0; c < nc; c++) {
+                if(a[c] != b[c]) {
+                    rc0 = std::min(rc0, c);
+                    rc1 = c;
+                    changed++;
                 }
-                else
-                    i->setText(QString::number(m[r][c]));
             }
         }
+        if(rc0 < nc) { // row r changed: extend the block
+            if(r0 < 0) r0 = r;
+            c0 = std::min(c0, rc0);
+            c1 = std::max(c1, rc1);
+        }
+        else if(r0 > -1) { // block ends at r - 1
+            blocks << qMakePair(index(r0, c0), index(r - 1, c1));
+            r0 = -1;
+            c0 = nc;
+            c1 = 0;
+        }
     }
-    else
-        printf("MyDisplayMatrix::setMyData: data unchanged\n");
+    m_m = m;
+    for(int i = 0; i < blocks.size(); i++)
+        emit dataChanged(blocks[i].first, blocks[i].second, QVector<int>() << Qt::DisplayRole);
+    return changed;
+}
+
+const CuMatrix<double> &MyMatrixModel::matrix() const {
+    return m_m;
+}
+
+int MyMatrixModel::rowCount(const QModelIndex &parent) const {
+    return parent.isValid() ? 0 : m_m.nrows();
+}
+
+int MyMatrixModel::columnCount(const QModelIndex &parent) const {
+    return parent.isValid() ? 0 : m_m.ncols();
+}
+
+QVariant MyMatrixModel::data(const QModelIndex &index, int role) const {
+    if(role == Qt::DisplayRole && index.isValid())
+        return QString::number(m_m[index.row()][index.column()]);
+    return QVariant();
+}
+
+MyDisplayMatrix::MyDisplayMatrix(QWidget *parent) : QTableView(parent) {
+    m_model = new MyMatrixModel(this);
+    setModel(m_model);
+    m_set_ns = m_paint_ns = 0;
+    m_sets = m_paints = m_changed = 0;
+    m_stats = false;
+    m_stats_t.start();
+}
+
+/*
+ * print the statistics once per second, see paintEvent
+ */
+void MyDisplayMatrix::setStatsEnabled(bool en) {
+    m_stats = en;
+}
+
+void MyDisplayMatrix::setMyData(const CuMatrix<double> &m) {
+    QElapsedTimer t;
+    t.start();
+    int changed = m_model->setMatrix(m);
+    m_set_ns += t.nsecsElapsed();
+    m_changed += changed < 0 ? m.nrows() * m.ncols() : changed;
+    m_sets++;
 }
 
 CuMatrix<double> MyDisplayMatrix::myData() const {
-    std::vector<double> v;
-    for(int i = 0; i < rowCount(); i++)
-        for(int j = 0; j < columnCount(); j++)
-            v.push_back( item(i, j)->text().toDouble());
-    return CuMatrix<double>(v, rowCount(), columnCount());
+    return m_model->matrix();
+}
+
+void MyDisplayMatrix::paintEvent(QPaintEvent *e) {
+    QElapsedTimer t;
+    t.start();
+    QTableView::paintEvent(e);
+    m_paint_ns += t.nsecsElapsed();
+    m_paints++;
+    if(m_stats && m_stats_t.elapsed() >= 1000 && m_sets > 0) {
+        printf("MyDisplayMatrix: %zux%zu: %d updates, %.1f cells changed/update, compare %.1fus/update, paint %.1fus/paint (%d paints)\n",
+               m_model->matrix().nrows(), m_model->matrix().ncols(), m_sets, m_changed / (double) m_sets,
+               m_set_ns / 1e3 / m_sets, m_paint_ns / 1e3 / m_paints, m_paints);
+        m_set_ns = m_paint_ns = 0;
+        m_sets = m_paints = m_changed = 0;
+        m_stats_t.restart();
+    }
 }
 
 MyDisplayVector::MyDisplayVector(QWidget *parent) : QuPlotBase(parent) {
@@ -106,6 +186,7 @@ Magicdemo::Magicdemo(CumbiaPool *cumbia_pool, QWidget *parent) :
 
         // matrix!
         CuMagicI *mamatrix = plugin_i->new_magic(ui->tableWidget, "$1/double_image_ro", "myData");
+        ui->tableWidget->setStatsEnabled(qApp->arguments().contains("--matrix-stats"));
 
     }
 
@@ -2,7 +2,9 @@
 #define Magicdemo_H
 
 #include <QWidget>
-#include <QTableWidget>
+#include <QTableView>
+#include <QAbstractTableModel>
+#include <QElapsedTimer>
 
 // cumbia
 #include <qulogimpl.h>
@@ -16,13 +18,49 @@ namespace Ui {
 class Magicdemo;
 }
 
-class MyDisplayMatrix : public QTableWidget {
+/*
+ * the model holds the CuMatrix as it is received: cells are formatted only when the view
+ * asks for the visible ones. setMatrix compares the new matrix with the current one and
+ * signals dataChanged for the blocks of rows that changed only, restricted to the columns
+ * that changed in those rows
+ */
+class MyMatrixModel : public QAbstractTableModel {
+    Q_OBJECT
+public:
+    MyMatrixModel(QObject *parent) : QAbstractTableModel(parent) {}
+    int setMatrix(const CuMatrix<double> &m);
+    const CuMatrix<double>& matrix() const;
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const;
+
+private:
+    CuMatrix<double> m_m;
+};
+
+/*
+ * table view of a CuMatrix<double> property. With setStatsEnabled (--matrix-stats on the command
+ * line), the time spent to compare the data and to paint the view is averaged and printed once per second
+ */
+class MyDisplayMatrix : public QTableView {
     Q_OBJECT
     Q_PROPERTY(CuMatrix <double> myData READ myData WRITE setMyData)
 public:
-    MyDisplayMatrix(QWidget *parent) : QTableWidget(parent) {}
+    MyDisplayMatrix(QWidget *parent);
     void setMyData(const CuMatrix<double> &m);
     CuMatrix<double> myData() const;
+    void setStatsEnabled(bool en);
+
+protected:
+    void paintEvent(QPaintEvent *e);
+
+private:
+    MyMatrixModel *m_model;
+    bool m_stats;
+    QElapsedTimer m_stats_t;
+    qint64 m_set_ns, m_paint_ns;
+    int m_sets, m_paints, m_changed;
 };
 
 class MyDisplayVector : public QuPlotBase {
@@ -0,0 +1,53 @@
+isEmpty(CUMBIA_ROOT) {
+    CUMBIA_ROOT=/usr/local/cumbia-libs
+}
+include($${CUMBIA_ROOT}/include/quapps/quapps.pri)
+
+# CONFIG += debug | release
+
+DEFINES -= QT_NO_DEBUG_OUTPUT
+
+# RESOURCES +=
+
+SOURCES += src/main.cpp \
+                src/magicstress.cpp
+
+HEADERS += src/magicstress.h
+
+# no ui file: the widgets are created at runtime
+#
+INCLUDEPATH += src
+
+TARGET = magicstress
+
+!wasm-emscripten {
+    TARGET   = bin/$${TARGET}
+} else {
+    TARGET = wasm/$${TARGET}
+}
+
+#
+# make install works if INSTALL_DIR is given to qmake
+#
+!isEmpty(INSTALL_DIR) {
+    wasm-emscripten {
+        inst.files = wasm/*
+    } else {
+        inst.files = $${TARGET}
+    }
+    inst.path = $${INSTALL_DIR}
+    INSTALLS += inst
+    message("-")
+    message("INSTALLATION")
+    message("       execute `make install` to install 'magicstress' under $${INSTALL_DIR} ")
+    message("-")
+} else {
+    message("-")
+    message("INSTALLATION")
+    message("       call qmake INSTALL_DIR=/usr/local/bin to install magicstress later with `make install` ")
+    message("-")
+}
+
+# unix:LIBS += -L. -lmylib
+
+# unix:INCLUDEPATH +=  . ../../src
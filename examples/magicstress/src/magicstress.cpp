@@ -0,0 +1,304 @@
+#include "magicstress.h"
+
+// cumbia
+#include <cumbiapool.h>
+#include <cuserviceprovider.h>
+#include <cumacros.h>
+#include <cudata.h>
+#include <quapps.h>
+// cumbia
+
+#include <cumagicplugininterface.h>
+#include <QGridLayout>
+#include <QScrollArea>
+#include <QLabel>
+#include <QProgressBar>
+#include <QLCDNumber>
+#include <QDoubleSpinBox>
+#include <QCheckBox>
+#include <QPainter>
+#include <QTimer>
+#include <QFile>
+#include <QJsonObject>
+#include <QJsonDocument>
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QThread>
+#include <QtDebug>
+#include <algorithm>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+StressCurve::StressCurve(QWidget *parent) : QWidget(parent) {
+    setMinimumSize(120, 60);
+}
+
+QVector<double> StressCurve::yData() const {
+    return m_y;
+}
+
+void StressCurve::setYData(const QVector<double> &y) {
+    m_y = y;
+    update();
+}
+
+void StressCurve::paintEvent(QPaintEvent *) {
+    QPainter p(this);
+    if(m_y.size() < 2)
+        return;
+    const double ymin = *std::min_element(m_y.begin(), m_y.end()), ymax = *std::max_element(m_y.begin(), m_y.end());
+    const double sx = width() / static_cast<double>(m_y.size() - 1), sy = ymax > ymin ? height() / (ymax - ymin) : 1.0;
+    QPolygonF poly(m_y.size());
+    for(int i = 0; i < m_y.size(); i++)
+        poly[i] = QPointF(i * sx, height() - (m_y[i] - ymin) * sy);
+    p.drawPolyline(poly);
+}
+
+StressSink::StressSink(QAtomicInt *count) : QObject(nullptr), m_count(count) {
+}
+
+QVector<double> StressSink::yData() const {
+    return m_y;
+}
+
+void StressSink::setYData(const QVector<double> &y) {
+    m_y = y;
+    m_count->ref();
+}
+
+// CPU time of the calling (GUI) thread, in seconds
+static double m_thread_cpu() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double m_now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec * 1e-3;
+}
+
+Magicstress::Magicstress(CumbiaPool *cumbia_pool, const MagicstressOptions &o, const QElapsedTimer& t_start, QWidget *parent) :
+    QWidget(parent)
+{
+    // cumbia
+    CuModuleLoader mloader(cumbia_pool, &m_ctrl_factory_pool, &m_log_impl);
+    cu_pool = cumbia_pool;
+    // cumbia
+    m_o = o;
+    m_t_start = t_start;
+    m_n_widgets = 0;
+    m_updates = 0;
+    m_sink_updates0 = 0;
+    m_startup_ns = 0;
+    m_cpu0 = 0.0;
+    m_measuring = false;
+
+    QScrollArea *sa = new QScrollArea(this);
+    QWidget *container = new QWidget(sa);
+    m_lo = new QGridLayout(container);
+    sa->setWidget(container);
+    sa->setWidgetResizable(true);
+    QGridLayout *lo = new QGridLayout(this);
+    lo->addWidget(sa, 0, 0);
+    resize(1200, 900);
+
+    QObject *magic_plo;
+    CuMagicPluginInterface *plugin_i = CuMagicPluginInterface::get_instance(cumbia_pool, m_ctrl_factory_pool, &magic_plo);
+    if(!plugin_i)
+        perr("Magicstress: failed to load plugin \"%s\"", qstoc(CuMagicPluginInterface::file_name()));
+    else {
+        m_create(plugin_i);
+        m_create_headless(plugin_i);
+    }
+    // the first cycle of the event loop after show ends the startup
+    QTimer::singleShot(0, this, SLOT(startMeasure()));
+}
+
+Magicstress::~Magicstress()
+{
+    foreach(QThread *th, m_threads) { // the sinks go with their thread
+        th->quit();
+        th->wait();
+    }
+}
+
+QWidget *Magicstress::m_add(QWidget *w) {
+    const int cols = 20;
+    m_lo->addWidget(w, m_n_widgets / cols, m_n_widgets % cols);
+    m_n_widgets++;
+    w->installEventFilter(this);
+    return w;
+}
+
+/*
+ * round robin over the kinds of target: scalar widgets, index selectors, vector properties,
+ * fan-out onto mapped objects and, first, the matrix targets
+ */
+void Magicstress::m_create(CuMagicPluginInterface *plugin_i) {
+    plugin_i->registerSynthEngine();
+    plugin_i->setUpdateBudget(m_o.budget_us);
+    const QString hz = QString("hz=%1").arg(m_o.hz);
+    for(int i = 0; i < m_o.magics; i++) {
+        CuMagicI *ma = nullptr;
+        QWidget *t = nullptr;
+        if(i < m_o.matrices) {
+            t = m_add(new QLabel(this));
+            ma = plugin_i->new_magic(t, QString("synth://sine/double_image?rows=%1&cols=%1&%2").arg(m_o.matrix_size).arg(hz));
+        }
+        else switch(i % 8) {
+        case 0:
+            t = m_add(new QLabel(this));
+            ma = plugin_i->new_magic(t, "synth://sine/double_scalar?" + hz, "text");
+            break;
+        case 1:
+            t = m_add(new QProgressBar(this));
+            ma = plugin_i->new_magic(t, "synth://ramp/short_scalar?amp=100&" + hz);
+            break;
+        case 2:
+            t = m_add(new QLCDNumber(this));
+            ma = plugin_i->new_magic(t, "synth://random/float_scalar?" + hz);
+            break;
+        case 3:
+            t = m_add(new QDoubleSpinBox(this));
+            ma = plugin_i->new_magic(t, "synth://sine/double_scalar?" + hz);
+            break;
+        case 4:
+            t = m_add(new QCheckBox(this));
+            ma = plugin_i->new_magic(t, "synth://random/boolean_scalar?" + hz, "checked");
+            break;
+        case 5: // index selector
+            t = m_add(new QLabel(this));
+            ma = plugin_i->new_magic(t, QString("synth://sine/double_spectrum?n=%1&%2[%3]").arg(m_o.spectrum_size).arg(hz).arg(i % m_o.spectrum_size), "text");
+            break;
+        case 6:
+            t = m_add(new StressCurve(this));
+            ma = plugin_i->new_magic(t, QString("synth://sine/double_spectrum?n=%1&%2").arg(m_o.spectrum_size).arg(hz), "yData");
+            break;
+        default: { // fan-out: one value to each of the children
+            t = m_add(new QWidget(this));
+            QGridLayout *flo = new QGridLayout(t);
+            ma = plugin_i->new_magic(t);
+            for(int j = 0; j < m_o.fanout; j++) {
+                QLabel *l = new QLabel(t);
+                l->setObjectName(QString("f%1_%2").arg(i).arg(j));
+                flo->addWidget(l, 0, j);
+                ma->map(j, l, "text");
+            }
+            ma->setSource(QString("synth://sine/double_spectrum?n=%1&%2").arg(std::max(m_o.fanout, 1)).arg(hz));
+            if(m_o.fanout > 0) { // latency measured on the first mapped object
+                t = t->findChild<QLabel *>();
+                t->installEventFilter(this);
+            }
+        }
+            break;
+        }
+        QObject *mo = dynamic_cast<QObject *>(ma);
+        if(mo) {
+            m_targets.insert(mo, t);
+            connect(mo, SIGNAL(newData(CuData)), this, SLOT(onNewData(CuData)));
+        }
+    }
+}
+
+/*
+ * headless magics on StressSink objects, spread over the worker threads. The values are applied in the
+ * workers: headless_updates_per_s against threads shows how the headless path scales
+ */
+void Magicstress::m_create_headless(CuMagicPluginInterface *plugin_i) {
+    const QString src = QString("synth://sine/double_spectrum?n=%1&hz=%2").arg(m_o.spectrum_size).arg(m_o.hz);
+    for(int i = 0; i < m_o.threads && m_o.headless > 0; i++) {
+        QThread *th = new QThread(this);
+        th->start();
+        m_threads << th;
+    }
+    for(int i = 0; i < m_o.headless && !m_threads.isEmpty(); i++) {
+        QThread *th = m_threads[i % m_threads.size()];
+        StressSink *sink = new StressSink(&m_sink_updates);
+        sink->moveToThread(th);
+        connect(th, SIGNAL(finished()), sink, SLOT(deleteLater()));
+        plugin_i->new_magic_headless(sink, src, "yData");
+    }
+}
+
+void Magicstress::onNewData(const CuData &da) {
+    if(!m_measuring || da[CuDType::Err].toBool())  // da["err"]
+        return;
+    m_updates++;
+    QWidget *t = m_targets.value(sender());
+    if(t && !m_pending_us.contains(t)) {
+        const double ts = CuMagicI::timestamp_us(da);
+        m_pending_us.insert(t, ts > 0 ? ts : m_now_us());
+    }
+}
+
+// update to paint latency: from the timestamp of the oldest data not yet painted to the paint event
+bool Magicstress::eventFilter(QObject *o, QEvent *e) {
+    if(m_measuring && e->type() == QEvent::Paint) {
+        QHash<QWidget *, double>::iterator it = m_pending_us.find(static_cast<QWidget *>(o));
+        if(it != m_pending_us.end()) {
+            if(m_latencies_ms.size() < 2000000)
+                m_latencies_ms.push_back((m_now_us() - it.value()) / 1000.0);
+            m_pending_us.erase(it);
+        }
+    }
+    return QWidget::eventFilter(o, e);
+}
+
+void Magicstress::startMeasure() {
+    m_startup_ns = m_t_start.nsecsElapsed();
+    m_measuring = true;
+    m_cpu0 = m_thread_cpu();
+    m_sink_updates0 = m_sink_updates.load();
+    m_t.start();
+    QTimer::singleShot(m_o.duration * 1000, this, SLOT(report()));
+}
+
+void Magicstress::report() {
+    m_measuring = false;
+    const double secs = m_t.nsecsElapsed() * 1e-9, cpu = m_thread_cpu() - m_cpu0;
+    std::sort(m_latencies_ms.begin(), m_latencies_ms.end());
+    const size_t n = m_latencies_ms.size();
+    long rss_pages = 0, size_pages = 0;
+    FILE *fp = fopen("/proc/self/statm", "r");
+    if(fp) {
+        if(fscanf(fp, "%ld %ld", &size_pages, &rss_pages) != 2)
+            rss_pages = 0;
+        fclose(fp);
+    }
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+
+    QJsonObject conf, res, rep;
+    conf["magics"] = m_o.magics;
+    conf["hz"] = m_o.hz;
+    conf["duration_s"] = m_o.duration;
+    conf["spectrum_size"] = m_o.spectrum_size;
+    conf["fanout"] = m_o.fanout;
+    conf["matrices"] = m_o.matrices;
+    conf["matrix_size"] = m_o.matrix_size;
+    conf["budget_us"] = m_o.budget_us;
+    conf["headless"] = m_o.headless;
+    conf["threads"] = m_o.threads;
+    res["updates_per_s"] = m_updates / secs;
+    res["gui_thread_utilisation"] = cpu / secs;
+    res["headless_updates_per_s"] = (m_sink_updates.load() - m_sink_updates0) / secs;
+    res["latency_samples"] = static_cast<double>(n);
+    res["latency_p50_ms"] = n ? m_latencies_ms[n / 2] : 0.0;
+    res["latency_p99_ms"] = n ? m_latencies_ms[std::min(n - 1, n * 99 / 100)] : 0.0;
+    res["startup_ms"] = m_startup_ns / 1e6;
+    res["rss_kb"] = static_cast<double>(rss_pages * sysconf(_SC_PAGESIZE) / 1024);
+    res["max_rss_kb"] = static_cast<double>(ru.ru_maxrss);
+    rep["config"] = conf;
+    rep["results"] = res;
+    rep["date"] = QDateTime::currentDateTime().toString(Qt::ISODate);
+    const QByteArray& json = QJsonDocument(rep).toJson();
+    QFile f(m_o.json);
+    if(!m_o.json.isEmpty() && f.open(QIODevice::WriteOnly))
+        f.write(json);
+    else
+        printf("%s\n", json.constData());
+    qApp->quit();
+}
@@ -0,0 +1,110 @@
+#ifndef Magicstress_H
+#define Magicstress_H
+
+#include <QWidget>
+#include <QVector>
+#include <QHash>
+#include <QElapsedTimer>
+#include <QAtomicInt>
+#include <vector>
+
+// cumbia
+#include <qulogimpl.h>
+#include <cucontrolsfactorypool.h>
+class CumbiaPool;
+class CuData;
+// cumbia
+
+class CuMagicPluginInterface;
+class QGridLayout;
+class QThread;
+
+/*
+ * a plot-like target with a QVector<double> property, painted as a polyline
+ */
+class StressCurve : public QWidget {
+    Q_OBJECT
+    Q_PROPERTY(QVector<double> yData READ yData WRITE setYData)
+public:
+    StressCurve(QWidget *parent);
+    QVector<double> yData() const;
+    void setYData(const QVector<double>& y);
+protected:
+    void paintEvent(QPaintEvent *e);
+private:
+    QVector<double> m_y;
+};
+
+/*
+ * the target of a headless magic, in a worker thread: counts the values it receives
+ */
+class StressSink : public QObject {
+    Q_OBJECT
+    Q_PROPERTY(QVector<double> yData READ yData WRITE setYData)
+public:
+    StressSink(QAtomicInt *count);
+    QVector<double> yData() const;
+    void setYData(const QVector<double>& y);
+private:
+    QVector<double> m_y;
+    QAtomicInt *m_count;
+};
+
+class MagicstressOptions {
+public:
+    int magics; // number of magics
+    double hz; // update rate of each source
+    int duration; // seconds of measurement
+    int spectrum_size;
+    int fanout; // objects mapped by each fan-out magic
+    int matrices; // number of matrix (image) targets
+    int matrix_size;
+    int budget_us; // CuMagicPluginInterface::setUpdateBudget
+    int headless; // headless magics, in addition to magics
+    int threads; // worker threads of the headless targets
+    QString json; // report file, stdout if empty
+};
+
+class Magicstress : public QWidget
+{
+    Q_OBJECT
+
+public:
+    explicit Magicstress(CumbiaPool *cu_p, const MagicstressOptions& o, const QElapsedTimer& t_start, QWidget *parent = 0);
+    ~Magicstress();
+
+    bool eventFilter(QObject *o, QEvent *e);
+
+private slots:
+    void onNewData(const CuData& da);
+    void startMeasure();
+    void report();
+
+private:
+    void m_create(CuMagicPluginInterface *plugin_i);
+    void m_create_headless(CuMagicPluginInterface *plugin_i);
+    QWidget *m_add(QWidget *w);
+
+    MagicstressOptions m_o;
+    QGridLayout *m_lo;
+    int m_n_widgets;
+    QHash<QObject *, QWidget *> m_targets; // magic --> target widget
+    QHash<QWidget *, double> m_pending_us; // target --> timestamp of the oldest data not painted yet
+    std::vector<double> m_latencies_ms;
+    QElapsedTimer m_t_start, m_t; // since main, since the start of the measurement
+    qint64 m_startup_ns;
+    qint64 m_updates;
+    QList<QThread *> m_threads;
+    QAtomicInt m_sink_updates; // values received by the StressSink objects
+    int m_sink_updates0;
+    double m_cpu0;
+    bool m_measuring;
+
+    // cumbia
+    CumbiaPool *cu_pool;
+    QuLogImpl m_log_impl;
+    CuControlsFactoryPool m_ctrl_factory_pool;
+    // cumbia
+};
+
+#endif // Magicstress_H
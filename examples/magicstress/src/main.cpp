@@ -0,0 +1,67 @@
+#include <quapplication.h>
+#include "magicstress.h"
+
+// cumbia
+#include <cumbiapool.h>
+#include <cuthreadfactoryimpl.h>
+#include <qthreadseventbridgefactory.h>
+// cumbia
+
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+
+#define VERSION "1.0"
+
+int main(int argc, char *argv[])
+{
+    QElapsedTimer t_start;
+    t_start.start();
+    QuApplication qu_app( argc, argv );
+    qu_app.setOrganizationName("Elettra");
+    qu_app.setApplicationName("Magicstress");
+    QString version(VERSION);
+    qu_app.setApplicationVersion(version);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("cumbia magic plugin scalability benchmark. Sources are generated by the synth:// engine");
+    parser.addHelpOption();
+    parser.addOption(QCommandLineOption("magics", "number of magics", "N", "1000"));
+    parser.addOption(QCommandLineOption("hz", "updates per second of each source", "HZ", "10"));
+    parser.addOption(QCommandLineOption("duration", "seconds of measurement", "S", "20"));
+    parser.addOption(QCommandLineOption("spectrum", "size of the spectra", "N", "1000"));
+    parser.addOption(QCommandLineOption("fanout", "objects mapped by each fan-out magic", "N", "8"));
+    parser.addOption(QCommandLineOption("matrices", "number of matrix targets, included in magics", "N", "4"));
+    parser.addOption(QCommandLineOption("matrix-size", "rows and columns of the matrices", "N", "256"));
+    parser.addOption(QCommandLineOption("budget", "update budget per event loop cycle, microseconds (0: none)", "US", "0"));
+    parser.addOption(QCommandLineOption("headless", "headless magics on QObject targets in worker threads, in addition to magics", "N", "0"));
+    parser.addOption(QCommandLineOption("threads", "worker threads of the headless targets", "N", "4"));
+    parser.addOption(QCommandLineOption("json", "write the report to this file instead of stdout", "FILE"));
+    parser.process(qu_app);
+
+    MagicstressOptions o;
+    o.magics = parser.value("magics").toInt();
+    o.hz = parser.value("hz").toDouble();
+    o.duration = parser.value("duration").toInt();
+    o.spectrum_size = parser.value("spectrum").toInt();
+    o.fanout = parser.value("fanout").toInt();
+    o.matrices = parser.value("matrices").toInt();
+    o.matrix_size = parser.value("matrix-size").toInt();
+    o.budget_us = parser.value("budget").toInt();
+    o.headless = parser.value("headless").toInt();
+    o.threads = parser.value("threads").toInt();
+    o.json = parser.value("json");
+
+    CumbiaPool *cu_p = new CumbiaPool();
+    Magicstress *w = new Magicstress(cu_p, o, t_start, NULL);
+    w->show();
+    // exec application loop
+    int ret = qu_app.exec();
+    // delete resources and return
+    delete w;
+
+    for(std::string n : cu_p->names())
+        if(n != "synth" && cu_p->get(n)) // the synth engine belongs to the magic plugin
+            delete cu_p->get(n);
+
+    return ret;
+}